@@ -39,6 +39,8 @@ is_jb_or_later := $(shell ( test $(PLATFORM_VERSION_MAJ) -gt 4 || \
                     ( test $(PLATFORM_VERSION_MAJ) -eq 4 && \
                       test $(PLATFORM_VERSION_MIN) -ge 1 ) ) && echo 1 || echo 0)
 
+has_frame_timestamps := $(shell test $(PLATFORM_VERSION_MAJ) -ge 8 && echo 1 || echo 0)
+
 LOCAL_SRC_FILES:= \
     adtf.cpp \
     FileThread.cpp \
@@ -46,8 +48,26 @@ LOCAL_SRC_FILES:= \
     ThreadManager.cpp \
     SolidThread.cpp \
     SpecParser.cpp \
+    SpecCache.cpp \
     Stat.cpp \
     PluginThread.cpp \
+    PerfCounters.cpp \
+    ControlSocket.cpp \
+    Saturation.cpp \
+    Animation.cpp \
+    PresentTracker.cpp \
+    BufferPipeline.cpp \
+    FrameLoader.cpp \
+    FrameCodec.cpp \
+    FrameDecoder.cpp \
+    FrameVerifier.cpp \
+    RefCompositor.cpp \
+    CaptureWriter.cpp \
+    ProcessGroup.cpp \
+    StartupGate.cpp \
+    EglCache.cpp \
+    GlGroup.cpp \
+    Gles2Renderer.cpp \
 
 LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES
 
@@ -59,6 +79,7 @@ LOCAL_SHARED_LIBRARIES := \
     libui \
     libstlport \
     libGLESv1_CM \
+    libGLESv2 \
     libEGL \
     libdl \
 
@@ -72,6 +93,10 @@ else
 LOCAL_CFLAGS += -DADTF_ICS_AND_EARLIER
 endif
 
+ifeq ($(has_frame_timestamps),1)
+LOCAL_CFLAGS += -DADTF_HAVE_FRAME_TIMESTAMPS
+endif
+
 LOCAL_MODULE:= adtf
 
 LOCAL_MODULE_TAGS := tests
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <math.h>
+#include <algorithm>
+
+#include "Animation.h"
+
+using namespace android;
+using namespace std;
+
+static bool keyframeEarlier(const Keyframe& x, const Keyframe& y)
+{
+    return x.time < y.time;
+}
+
+inline int interpolate(int from, int to, float f)
+{
+    return from + (int)floorf((to - from) * f + 0.5f);
+}
+
+Animation::Animation() : mDuration(0)
+{
+    for (int t = 0; t < Keyframe::TRACK_MAX; t++) {
+        mCursor[t] = 0;
+        mLast[t] = 0;
+    }
+}
+
+void Animation::build(const List<Keyframe>& keyframes, bool loop)
+{
+    mDuration = 0;
+
+    for (int t = 0; t < Keyframe::TRACK_MAX; t++) {
+        vector<Keyframe> keys;
+        for (List<Keyframe>::const_iterator it = keyframes.begin(); it != keyframes.end(); ++it) {
+            if (it->track == t)
+                keys.push_back(*it);
+        }
+        stable_sort(keys.begin(), keys.end(), keyframeEarlier);
+
+        mSegments[t].clear();
+        mCursor[t] = 0;
+        mLast[t] = 0;
+        if (keys.empty())
+            continue;
+
+        // Hold the first value until its keyframe is reached
+        Segment s;
+        s.start = 0;
+        s.end = ms2ns(keys[0].time);
+        s.a0 = s.a1 = keys[0].a;
+        s.b0 = s.b1 = keys[0].b;
+        s.easing = Keyframe::LINEAR;
+        mSegments[t].push_back(s);
+
+        for (size_t i = 1; i < keys.size(); i++) {
+            s.start = ms2ns(keys[i - 1].time);
+            s.end = ms2ns(keys[i].time);
+            s.a0 = keys[i - 1].a;
+            s.b0 = keys[i - 1].b;
+            s.a1 = keys[i].a;
+            s.b1 = keys[i].b;
+            s.easing = keys[i].easing;
+            mSegments[t].push_back(s);
+        }
+
+        mDuration = max(mDuration, s.end);
+    }
+
+    if (!loop)
+        mDuration = 0;
+}
+
+bool Animation::hasTrack(Keyframe::Track track) const
+{
+    return !mSegments[track].empty();
+}
+
+bool Animation::evaluate(Keyframe::Track track, nsecs_t t, int& a, int& b)
+{
+    const vector<Segment>& segments = mSegments[track];
+    if (segments.empty())
+        return false;
+
+    if (t < 0)
+        t = 0;
+    if (mDuration > 0)
+        t %= mDuration;
+
+    // Start over when the loop wraps
+    size_t& c = mCursor[track];
+    if (t < mLast[track])
+        c = 0;
+    mLast[track] = t;
+
+    while (c + 1 < segments.size() && t >= segments[c].end)
+        c++;
+
+    // Past the last keyframe the segment end value holds
+    const Segment& s = segments[c];
+    float f = 1.0f;
+    if (t < s.end && s.end > s.start)
+        f = (float)(t - s.start) / (s.end - s.start);
+    if (s.easing == Keyframe::EASE)
+        f = f * f * (3.0f - 2.0f * f);
+
+    a = interpolate(s.a0, s.a1, f);
+    b = interpolate(s.b0, s.b1, f);
+    return true;
+}
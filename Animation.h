@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _ANIMATION_H
+#define _ANIMATION_H
+
+#include <vector>
+#include <utils/List.h>
+#include <utils/Timers.h>
+
+#include "LocalTypes.h"
+
+using namespace android;
+
+// Keyframe tracks of a surface, precomputed into time ordered segments.
+// Evaluation is by time rather than iteration, so late frames land where
+// they should instead of slowing the animation down.
+class Animation {
+    public:
+        Animation();
+
+        void build(const List<Keyframe>& keyframes, bool loop);
+        bool hasTrack(Keyframe::Track track) const;
+
+        // Value of track at t ns after the surface started. Times are
+        // expected to increase between calls, false if there is no track.
+        bool evaluate(Keyframe::Track track, nsecs_t t, int& a, int& b);
+
+    private:
+        struct Segment {
+            nsecs_t start;
+            nsecs_t end;
+            int a0, b0;
+            int a1, b1;
+            Keyframe::Easing easing;
+        };
+
+        std::vector<Segment> mSegments[Keyframe::TRACK_MAX];
+        size_t mCursor[Keyframe::TRACK_MAX];
+        nsecs_t mLast[Keyframe::TRACK_MAX];
+        nsecs_t mDuration; // Loop length, 0 unless looping
+};
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <utils/Log.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include "BufferPipeline.h"
+#include "TestBase.h"
+
+using namespace android;
+using namespace std;
+
+BufferPipeline::BufferPipeline(string name, sp<ANativeWindow> window, Filler *filler,
+        unsigned int depth, bool nv12, int usage) :
+    Thread(false), mName(name), mWindow(window), mFiller(filler), mDepth(depth),
+    mNV12(nv12), mUsage(usage), mStopping(false), mFailed(false), mProducerWait(0)
+{
+}
+
+BufferPipeline::~BufferPipeline()
+{
+    stop();
+}
+
+bool BufferPipeline::fill(Frame& f)
+{
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    ANativeWindow *w = mWindow.get();
+    int res;
+
+    nsecs_t start = systemTime();
+    res = w->dequeueBuffer(w, &f.buffer);
+    if (res == 0) {
+        res = w->lockBuffer(w, f.buffer);
+        if (res != 0)
+            w->cancelBuffer(w, f.buffer);
+    }
+    if (res != 0) {
+        LOGE("\"%s\" pipeline failed to dequeue buffer", mName.c_str());
+        return false;
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        mProducerWait += ns2us(systemTime() - start);
+    }
+
+    ANativeWindowBuffer *b = f.buffer;
+    Rect bounds(0, 0, b->width, b->height);
+    void *d[2];
+    d[0] = d[1] = 0;
+
+    bool ok = mapper.lock(b->handle, mUsage, bounds, d) == 0 && d[0] != 0;
+    if (ok) {
+        char *uv = 0;
+        if (mNV12)
+            uv = d[1] != 0 ? (char*)d[1] : (char*)d[0] + b->height * b->stride;
+
+        f.read = f.written = 0;
+        ok = mFiller->fillBuffer(b, (char*)d[0], uv, f.read, f.written);
+        if (ok)
+            mFiller->bufferFilled(b, (char*)d[0], uv);
+        mapper.unlock(b->handle);
+    } else {
+        LOGE("\"%s\" pipeline failed to map buffer", mName.c_str());
+    }
+
+    if (!ok)
+        w->cancelBuffer(w, b);
+    return ok;
+}
+
+bool BufferPipeline::threadLoop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        while (mReady.size() >= mDepth && !mStopping)
+            mCondition.wait(mLock);
+        if (mStopping)
+            return false;
+    }
+
+    Frame f;
+    bool ok = fill(f);
+
+    Mutex::Autolock _l(mLock);
+    if (!ok) {
+        mFailed = true;
+        mCondition.broadcast();
+        return false;
+    }
+    mReady.push_back(f);
+    mCondition.broadcast();
+    return true;
+}
+
+bool BufferPipeline::post(uint64_t& read, uint64_t& written)
+{
+    Frame f;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mReady.empty() && !mFailed && !mStopping)
+            mCondition.wait(mLock);
+        if (mReady.empty())
+            return false;
+        f = mReady.front();
+        mReady.erase(mReady.begin());
+        mCondition.broadcast();
+    }
+
+    ANativeWindow *w = mWindow.get();
+    int res = w->queueBuffer(w, f.buffer);
+    if (res != 0) {
+        LOGE("\"%s\" pipeline failed to queue buffer", mName.c_str());
+        return false;
+    }
+
+    read = f.read;
+    written = f.written;
+    return true;
+}
+
+// Buffers filled but never posted go back to the window
+void BufferPipeline::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    requestExitAndWait();
+
+    ANativeWindow *w = mWindow.get();
+    Mutex::Autolock _l(mLock);
+    for (size_t i = 0; i < mReady.size(); i++)
+        w->cancelBuffer(w, mReady[i].buffer);
+    mReady.clear();
+}
+
+nsecs_t BufferPipeline::producerWait()
+{
+    Mutex::Autolock _l(mLock);
+    return mProducerWait;
+}
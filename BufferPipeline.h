@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _BUFFER_PIPELINE_H
+#define _BUFFER_PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <system/window.h>
+
+using namespace android;
+
+// Fills CPU buffers on a thread of its own. Up to depth buffers are dequeued
+// and filled ahead while the surface thread queues earlier ones, so content
+// generation overlaps composition and a slow buffer release only stalls the
+// producer. Buffers are queued in the order they were filled.
+class BufferPipeline : public Thread {
+    public:
+        class Filler {
+            public:
+                virtual ~Filler() {}
+                // Called on the pipeline thread with the buffer mapped for
+                // writing, uv is only set for NV12. Reports bytes moved.
+                virtual bool fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+                        uint64_t& read, uint64_t& written) = 0;
+                // A filled buffer, still mapped, about to be queued
+                virtual void bufferFilled(ANativeWindowBuffer *b, const char *bits,
+                        const char *uv) {}
+        };
+
+        BufferPipeline(std::string name, sp<ANativeWindow> window, Filler *filler,
+                unsigned int depth, bool nv12, int usage);
+        virtual ~BufferPipeline();
+
+        // Queues the oldest filled buffer, waiting for one if none is ready.
+        // False once the producer has failed.
+        bool post(uint64_t& read, uint64_t& written);
+        void stop();
+
+        // Time the producer spent waiting for free buffers (us)
+        nsecs_t producerWait();
+
+    private:
+        struct Frame {
+            ANativeWindowBuffer *buffer;
+            uint64_t read;
+            uint64_t written;
+        };
+
+        bool fill(Frame& f);
+        virtual bool threadLoop();
+
+        std::string mName;
+        sp<ANativeWindow> mWindow;
+        Filler *mFiller;
+        unsigned int mDepth;
+        bool mNV12;
+        int mUsage;
+
+        Mutex mLock;
+        Condition mCondition;
+        std::vector<Frame> mReady;
+        bool mStopping;
+        bool mFailed;
+        nsecs_t mProducerWait;
+};
+
+#endif
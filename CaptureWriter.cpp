@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CaptureWriter.h"
+#include "LocalTypes.h"
+
+using namespace android;
+using namespace std;
+
+CaptureWriter::CaptureWriter(string name, size_t frameSize, unsigned int frames) :
+    Thread(false), mName(name), mFrameSize(frameSize), mFrames(max(frames, 1u)),
+    mPool(NULL), mFd(-1), mWriting(false), mStopping(false), mFailed(false),
+    mWritten(0), mDropped(0)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    if (mFd >= 0)
+        close(mFd);
+    free(mPool);
+}
+
+bool CaptureWriter::open(string path)
+{
+    // Touch the whole pool now rather than fault it in on the producer
+    void *p = NULL;
+    if (posix_memalign(&p, 4096, mFrameSize * mFrames) != 0) {
+        LOGE("\"%s\" can't allocate %u capture frames of %llu bytes", mName.c_str(),
+                mFrames, (unsigned long long)mFrameSize);
+        return false;
+    }
+    mPool = (char*)p;
+    memset(mPool, 0, mFrameSize * mFrames);
+    for (unsigned int i = 0; i < mFrames; i++)
+        mFree.push_back(mPool + i * mFrameSize);
+
+    mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (mFd < 0) {
+        LOGE("\"%s\" can't open '%s' for capture: %s", mName.c_str(), path.c_str(),
+                strerror(errno));
+        return false;
+    }
+
+    LOGD("\"%s\" capturing to '%s', %u frames buffered", mName.c_str(), path.c_str(), mFrames);
+    return true;
+}
+
+char* CaptureWriter::acquire()
+{
+    Mutex::Autolock _l(mLock);
+    if (mFree.empty() || mStopping || mFailed) {
+        mDropped++;
+        return NULL;
+    }
+    char *frame = mFree.back();
+    mFree.pop_back();
+    return frame;
+}
+
+void CaptureWriter::post(char *frame)
+{
+    Mutex::Autolock _l(mLock);
+    mQueue.push_back(frame);
+    mCondition.broadcast();
+}
+
+bool CaptureWriter::threadLoop()
+{
+    char *frame;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mQueue.empty() && !mStopping)
+            mCondition.wait(mLock);
+        if (mQueue.empty())
+            return false;
+        frame = mQueue.front();
+        mWriting = true;
+    }
+
+    size_t done = 0;
+    while (done < mFrameSize) {
+        ssize_t n = write(mFd, frame + done, mFrameSize - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+
+    Mutex::Autolock _l(mLock);
+    if (done < mFrameSize && !mFailed) {
+        LOGE("\"%s\" capture write failed, capture stopped: %s", mName.c_str(), strerror(errno));
+        mFailed = true;
+    }
+    mQueue.erase(mQueue.begin());
+    mFree.push_back(frame);
+    mWriting = false;
+    if (!mFailed)
+        mWritten++;
+    mCondition.broadcast();
+    return !mFailed;
+}
+
+void CaptureWriter::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        while ((!mQueue.empty() || mWriting) && !mFailed)
+            mCondition.wait(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    requestExitAndWait();
+
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+void CaptureWriter::collect(Stat& stat)
+{
+    Mutex::Autolock _l(mLock);
+    stat.addCaptured(mWritten, mDropped);
+    mWritten = mDropped = 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _CAPTURE_WRITER_H
+#define _CAPTURE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <utils/threads.h>
+
+#include "Stat.h"
+
+using namespace android;
+
+// Appends captured frames to a file on a thread of its own, back to back in
+// the raw layout FileThread plays. Frames are copied into a pool allocated
+// up front; when the writer falls behind and the pool is empty the frame is
+// dropped and counted, the producer never waits for the disk.
+class CaptureWriter : public Thread {
+    public:
+        CaptureWriter(std::string name, size_t frameSize, unsigned int frames);
+        virtual ~CaptureWriter();
+
+        bool open(std::string path);
+
+        // A free frame to copy into, NULL if there is none
+        char* acquire();
+        void post(char *frame);
+
+        // Writes what is queued and closes the file
+        void stop();
+
+        // Hands counts since the last collect to stat
+        void collect(Stat& stat);
+
+    private:
+        virtual bool threadLoop();
+
+        std::string mName;
+        size_t mFrameSize;
+        unsigned int mFrames;
+        char *mPool;
+        int mFd;
+
+        Mutex mLock;
+        Condition mCondition;
+        std::vector<char*> mFree;
+        std::vector<char*> mQueue;
+        bool mWriting;  // Oldest queued frame is being written
+        bool mStopping;
+        bool mFailed;
+
+        // Counts since the last collect
+        unsigned int mWritten;
+        unsigned int mDropped;
+};
+
+#endif
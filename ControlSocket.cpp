@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ControlSocket.h"
+#include "ThreadManager.h"
+
+using namespace android;
+using namespace std;
+
+// How often blocked calls wake up to check for exit
+#define POLL_TIMEOUT_MS 250
+
+ControlSocket::ControlSocket(string name, ThreadManager *manager)
+    : Thread(false), mName(name), mManager(manager), mFd(-1)
+{
+}
+
+ControlSocket::~ControlSocket()
+{
+    if (mFd >= 0)
+        close(mFd);
+
+    if (!mName.empty() && mName[0] != '@')
+        unlink(mName.c_str());
+}
+
+status_t ControlSocket::readyToRun()
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+
+    if (mName.empty() || mName.size() >= sizeof(addr.sun_path)) {
+        LOGE("invalid control socket name '%s'", mName.c_str());
+        return BAD_VALUE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (mName[0] == '@') {
+        // Abstract namespace, leading NUL and no terminator
+        memcpy(addr.sun_path + 1, mName.c_str() + 1, mName.size() - 1);
+        len = offsetof(struct sockaddr_un, sun_path) + mName.size();
+    } else {
+        unlink(mName.c_str());
+        strcpy(addr.sun_path, mName.c_str());
+        len = sizeof(addr);
+    }
+
+    mFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (mFd < 0) {
+        LOGE("control socket: %s", strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+
+    if (bind(mFd, (struct sockaddr*)&addr, len) != 0 || listen(mFd, 1) != 0) {
+        LOGE("control socket '%s': %s", mName.c_str(), strerror(errno));
+        close(mFd);
+        mFd = -1;
+        return UNKNOWN_ERROR;
+    }
+
+    LOGI("listening for commands on '%s'", mName.c_str());
+    return NO_ERROR;
+}
+
+bool ControlSocket::threadLoop()
+{
+    struct pollfd p;
+    p.fd = mFd;
+    p.events = POLLIN;
+    p.revents = 0;
+
+    if (poll(&p, 1, POLL_TIMEOUT_MS) <= 0)
+        return true;
+
+    int client = accept(mFd, NULL, NULL);
+    if (client < 0) {
+        LOGW("control socket accept: %s", strerror(errno));
+        return true;
+    }
+
+    LOGD("control client connected");
+    serve(client);
+    close(client);
+    LOGD("control client disconnected");
+
+    return true;
+}
+
+void ControlSocket::serve(int fd)
+{
+    string pending;
+    char buf[256];
+
+    while (!exitPending()) {
+        struct pollfd p;
+        p.fd = fd;
+        p.events = POLLIN;
+        p.revents = 0;
+
+        int res = poll(&p, 1, POLL_TIMEOUT_MS);
+        if (res == 0)
+            continue;
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res < 0)
+            return;
+
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            return;
+        pending.append(buf, n);
+
+        size_t eol;
+        while ((eol = pending.find('\n')) != string::npos) {
+            string line = pending.substr(0, eol);
+            pending.erase(0, eol + 1);
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+            if (line.empty())
+                continue;
+
+            string reply = mManager->control(line);
+            if (write(fd, reply.c_str(), reply.size()) < 0)
+                return;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <utils/Timers.h>
+
+#include "EglCache.h"
+#include "LocalTypes.h"
+
+using namespace android;
+using namespace std;
+
+EglCache::EglCache() : mDisplay(EGL_NO_DISPLAY)
+{
+}
+
+EglCache& EglCache::get()
+{
+    static EglCache sCache;
+    return sCache;
+}
+
+EGLDisplay EglCache::display()
+{
+    Mutex::Autolock _l(mLock);
+
+    if (mDisplay != EGL_NO_DISPLAY)
+        return mDisplay;
+
+    nsecs_t start = systemTime();
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (dpy == EGL_NO_DISPLAY || eglInitialize(dpy, &major, &minor) == EGL_FALSE) {
+        LOGE("EGL display initialization failed, error 0x%x", eglGetError());
+        return EGL_NO_DISPLAY;
+    }
+
+    LOGD("EGL %d.%d initialized in %lldus", major, minor,
+            (long long)ns2us(systemTime() - start));
+    mDisplay = dpy;
+    return mDisplay;
+}
+
+bool EglCache::findConfig(const string& key, EGLConfig *config)
+{
+    Mutex::Autolock _l(mLock);
+
+    map<string, EGLConfig>::iterator it = mConfigs.find(key);
+    if (it == mConfigs.end())
+        return false;
+    *config = it->second;
+    return true;
+}
+
+void EglCache::addConfig(const string& key, EGLConfig config)
+{
+    Mutex::Autolock _l(mLock);
+    mConfigs[key] = config;
+}
+
+void EglCache::forgetConfig(const string& key)
+{
+    Mutex::Autolock _l(mLock);
+    mConfigs.erase(key);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EGL_CACHE_H
+#define _EGL_CACHE_H
+
+#include <map>
+#include <string>
+#include <EGL/egl.h>
+#include <utils/threads.h>
+
+using namespace android;
+
+// The EGL display and the configs chosen on it, shared by all surfaces of
+// the process. The display is initialized on first use and stays up for
+// the rest of the run, so neither surface bring-up nor a plugin reinit pays
+// for eglInitialize, and configs are chosen once per key rather than once
+// per surface. Keys name whatever the choice depends on, the format for the
+// default choice or the plugin and its arguments for a plugin's own.
+class EglCache {
+    public:
+        static EglCache& get();
+
+        // EGL_NO_DISPLAY if it can't be initialized
+        EGLDisplay display();
+
+        bool findConfig(const std::string& key, EGLConfig *config);
+        void addConfig(const std::string& key, EGLConfig config);
+        // Next find chooses again, for a plugin that asked for a reinit
+        void forgetConfig(const std::string& key);
+
+    private:
+        EglCache();
+
+        Mutex mLock;
+        EGLDisplay mDisplay;
+        std::map<std::string, EGLConfig> mConfigs;
+};
+
+#endif
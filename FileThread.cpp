@@ -33,12 +33,19 @@
 #define LOG_TAG "adtf"
 
 #include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sstream>
 
 #include "FileThread.h"
+#include "FrameCodec.h"
+#include "FrameDecoder.h"
+#include "FrameLoader.h"
+#include "Gles2Renderer.h"
 
 using namespace android;
 using namespace std;
@@ -46,7 +53,8 @@ using namespace std;
 FileThread::FileThread(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
         Mutex &exitLock, Condition &exitCondition) :
     TestBase(spec, client, exitLock, exitCondition), mFd(-1), mData(0),
-    mLength(0), mFrameSize(0), mFrames(0), mFrameIndex(0), mLineByLine(false)
+    mSource(0), mLength(0), mMapLength(0), mFrameSize(0), mFrames(0), mFrameIndex(0),
+    mLineByLine(false), mRenderer(0)
 {
 }
 
@@ -54,15 +62,31 @@ FileThread::~FileThread()
 {
     for (vector<GLuint>::iterator it = mTIds.begin(); it < mTIds.end(); it++ )
         glDeleteTextures(1, it);
+    delete mRenderer;
+
+    delete mSource;
 
     if (mData != 0)
-        munmap(mData, mLength);
+        munmap(mData, mMapLength);
 
     if (mFd > 0)
         close(mFd);
 }
 
-status_t FileThread::readyToRun()
+static int pixelBytes(PixelFormat format)
+{
+    return format == HAL_PIXEL_FORMAT_TI_BGRX ? 4 : bytesPerPixel(format);
+}
+
+size_t FileThread::frameSize(const sp<SurfaceSpec>& spec)
+{
+    const SrcGeometry& g = spec->srcGeometry;
+    if (spec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12)
+        return g.stride * g.height * 3 / 2;
+    return g.stride * g.height * pixelBytes(spec->bufferFormat);
+}
+
+status_t FileThread::prepare()
 {
     struct stat sb;
 
@@ -86,10 +110,21 @@ status_t FileThread::readyToRun()
         return UNKNOWN_ERROR;
     }
 
+    // GL uploads every frame up front, so it always maps the file. Coded
+    // clips are decoded ahead instead, read_ahead setting how far.
+    bool coded = FrameCodec::isCoded(fileName);
+    bool load = mSpec->readAhead > 0 && !coded;
+    if (load && mSpec->renderFlag(RenderFlags::GL)) {
+        LOGW("\"%s\" read_ahead ignored for GL surfaces", mSpec->name.c_str());
+        load = false;
+    }
+    // Coded GL clips are decoded into textures up front, no frame is left
+    // in memory to checksum while updating
+    if (coded && mSpec->verify && mSpec->renderFlag(RenderFlags::GL))
+        LOGW("\"%s\" verify ignored for coded GL clips", mSpec->name.c_str());
+
     mLength = sb.st_size;
-    mData = (char*)mmap(NULL, mLength, PROT_READ, MAP_PRIVATE, mFd, 0);
-    if (mData == MAP_FAILED) {
-        mData = 0;
+    if (!load && !coded && !mapFile()) {
         LOGE("\"%s\" mmap failed '%s'", mSpec->name.c_str(), fileName.c_str());
         signalExit();
         return UNKNOWN_ERROR;
@@ -113,16 +148,10 @@ status_t FileThread::readyToRun()
     // and pixel format. If actual file size is not a multiple of one frame size
     // we'll bail out to avoid crashing and burning.
 
-    if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12) {
-        mFrameSize = mSpec->srcGeometry.stride * mSpec->srcGeometry.height * 3 / 2;
-    } else {
-        if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_BGRX) {
-            mBpp = 4;
-        } else {
-            mBpp = bytesPerPixel(mSpec->bufferFormat);
-        }
+    mFrameSize = frameSize(mSpec);
+    if (mSpec->bufferFormat != HAL_PIXEL_FORMAT_TI_NV12) {
+        mBpp = pixelBytes(mSpec->bufferFormat);
         mLineByLine = false;
-        mFrameSize = mSpec->srcGeometry.stride * mSpec->srcGeometry.height * mBpp;
 
         if (!mSpec->renderFlag(RenderFlags::GL)) {
             Surface::SurfaceInfo info;
@@ -138,6 +167,18 @@ status_t FileThread::readyToRun()
         }
     }
 
+    // A coded clip holds whole frames by construction
+    FrameDecoder *decoder = 0;
+    if (coded) {
+        decoder = new FrameDecoder(mSpec->name);
+        mSource = decoder;
+        if (!decoder->open(fileName, mFrameSize)) {
+            signalExit();
+            return UNKNOWN_ERROR;
+        }
+        mLength = decoder->frames() * mFrameSize;
+    }
+
     if ((mLength % mFrameSize != 0)) {
         if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12) {
             LOGE("\"%s\" '%s' doesn't contain an integer number of frames (%dx%dx3/2=%d, file %d)",
@@ -160,7 +201,31 @@ status_t FileThread::readyToRun()
             mSpec->renderFlag(RenderFlags::GL));
     mFrames = frames > 0 ? min(frames,mFrames) : mFrames;
 
-    if (mSpec->renderFlag(RenderFlags::GL)) {
+    if (load) {
+        FrameLoader *loader = new FrameLoader(mSpec->name);
+        if (!loader->open(fileName.c_str(), mFrameSize, mFrames, mSpec->readAhead)) {
+            delete loader;
+            signalExit();
+            return UNKNOWN_ERROR;
+        }
+        mSource = loader;
+    } else if (decoder != 0 &&
+            !decoder->start(mFrames, max(mSpec->readAhead, 2u), 0)) {
+        signalExit();
+        return UNKNOWN_ERROR;
+    }
+
+    if (mSpec->renderFlag(RenderFlags::GL) && glesVersion() == 2) {
+        glClearColor(0,0,0,1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        eglSwapBuffers(mEglDisplay, mEglSurface);
+
+        mRenderer = new Gles2Renderer(mSpec);
+        if (!mRenderer->init() || !initTextures()) {
+            signalExit();
+            return UNKNOWN_ERROR;
+        }
+    } else if (mSpec->renderFlag(RenderFlags::GL)) {
         glShadeModel(GL_FLAT);
         glDisable(GL_DITHER);
         glDisable(GL_SCISSOR_TEST);
@@ -177,23 +242,114 @@ status_t FileThread::readyToRun()
         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        for (size_t i = 0; i < mFrames; i++) {
+        if (!initTextures()) {
+            signalExit();
+            return UNKNOWN_ERROR;
+        }
+    }
+    return TestBase::prepare();
+}
+
+// Without prefault flags the clip is faulted in lazily, which puts page
+// faults and disk reads in the first pass through it
+bool FileThread::mapFile()
+{
+    int prefault = mSpec->prefault;
+    void *p;
+
+    if (prefault & Prefault::HUGEPAGE) {
+        // Page cache pages are never huge, so read the clip into anonymous
+        // memory, rounded up to whole 2MB pages. mmap only aligns to small
+        // pages, so map 2MB more and trim to a 2MB aligned start, or the
+        // first and last huge page would straddle the mapping's ends.
+        const size_t huge = 2 * 1024 * 1024;
+        mMapLength = (mLength + huge - 1) & ~(huge - 1);
+        p = mmap(NULL, mMapLength + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+        char *base = (char*)p;
+        char *aligned = (char*)(((uintptr_t)base + huge - 1) & ~(uintptr_t)(huge - 1));
+        if (aligned > base)
+            munmap(base, aligned - base);
+        munmap(aligned + mMapLength, base + huge - aligned);
+        p = aligned;
+#ifdef MADV_HUGEPAGE
+        if (madvise(p, mMapLength, MADV_HUGEPAGE) != 0)
+            LOGW("\"%s\" no transparent huge pages: %s", mSpec->name.c_str(), strerror(errno));
+#else
+        LOGW("\"%s\" no transparent huge pages on this platform", mSpec->name.c_str());
+#endif
+        size_t done = 0;
+        while (done < mLength) {
+            ssize_t n = pread(mFd, (char*)p + done, mLength - done, done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                LOGE("\"%s\" read failed at %llu: %s", mSpec->name.c_str(),
+                        (unsigned long long)done, n < 0 ? strerror(errno) : "end of file");
+                munmap(p, mMapLength);
+                return false;
+            }
+            done += n;
+        }
+    } else {
+        int flags = MAP_PRIVATE;
+        if (prefault & Prefault::POPULATE)
+            flags |= MAP_POPULATE;
+        mMapLength = mLength;
+        p = mmap(NULL, mMapLength, PROT_READ, flags, mFd, 0);
+        if (p == MAP_FAILED)
+            return false;
+        if (prefault & Prefault::POPULATE)
+            madvise(p, mMapLength, MADV_WILLNEED);
+    }
+
+    if ((prefault & Prefault::MLOCK) && mlock(p, mMapLength) != 0)
+        LOGW("\"%s\" mlock of %llu bytes failed: %s", mSpec->name.c_str(),
+                (unsigned long long)mMapLength, strerror(errno));
+
+    mData = (char*)p;
+    return true;
+}
+
+// One texture per frame, two for NV12 with GLES 2. A coded clip is decoded
+// once through for this and then not needed any more.
+bool FileThread::initTextures()
+{
+    for (size_t i = 0; i < mFrames; i++) {
+        const char *p = mData + i * mFrameSize;
+        bool waited;
+        if (mSource != 0 && (p = mSource->acquire(waited)) == 0) {
+            LOGE("\"%s\" frame %u not available", mSpec->name.c_str(), (unsigned int)i);
+            return false;
+        }
+
+        if (mRenderer != 0) {
+            if (!mRenderer->addFrame(p))
+                return false;
+            accountBytes(mFrameSize, mFrameSize);
+        } else {
             GLuint tid;
             glGenTextures(1, &tid);
             glBindTexture(GL_TEXTURE_2D, tid);
             glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            if (!initTexture(mData + i * mFrameSize)) {
-                signalExit();
-                return UNKNOWN_ERROR;
-            }
+            if (!initTexture(p))
+                return false;
             mTIds.push_back(tid);
         }
+
+        if (mSource != 0)
+            mSource->release();
     }
-    return TestBase::readyToRun();
+
+    delete mSource;
+    mSource = 0;
+    return true;
 }
 
-bool FileThread::initTexture(void* p)
+bool FileThread::initTexture(const void* p)
 {
     bool ret = true;
     const int w = mSpec->srcGeometry.width;
@@ -232,6 +388,9 @@ bool FileThread::initTexture(void* p)
             }
             break;
         case HAL_PIXEL_FORMAT_TI_NV12:
+            LOGE("\"%s\" NV12 needs the GLES2 render flag", mSpec->name.c_str());
+            ret = false;
+            break;
         default:
             LOGE("\"%s\" unsupported texture format", mSpec->name.c_str());
             ret = false;
@@ -240,19 +399,92 @@ bool FileThread::initTexture(void* p)
 
     glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
 
+    if (ret)
+        accountBytes(w * h * mBpp, w * h * mBpp);
+
     return ret;
 }
 
+void FileThread::drawFrame(int width, int height)
+{
+    if (mRenderer != 0) {
+        mRenderer->draw(mFrameIndex, width, height);
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, mTIds.at(mFrameIndex));
+    glDrawTexiOES(0, 0, 0, width, height);
+}
+
+bool FileThread::fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+        uint64_t& read, uint64_t& written)
+{
+    const char *data = frame(), *src = data;
+    if (src == 0)
+        return false;
+
+    unsigned int h = min(mSpec->srcGeometry.height, b->height);
+    unsigned int bytes;
+    char *dst = bits;
+
+    if (uv != 0) {
+        unsigned int sl = mSpec->srcGeometry.stride, dl = b->stride;
+        bytes = min(mSpec->srcGeometry.width, b->width);
+        for (unsigned int i = 0; i < h; i++, dst += dl, src += sl)
+            memcpy(dst, src, bytes);
+        dst = uv;
+        for (unsigned int i = 0; i < h / 2; i++, dst += dl, src += sl)
+            memcpy(dst, src, bytes);
+        h += h / 2;
+    } else {
+        unsigned int sl = mSpec->srcGeometry.stride * mBpp, dl = b->stride * mBpp;
+        bytes = min(sl, dl);
+        for (unsigned int i = 0; i < h; i++, dst += dl, src += sl)
+            memcpy(dst, src, bytes);
+    }
+
+    read = written = (uint64_t)h * bytes;
+    verifyFrame(mFrameIndex, data, mFrameSize, mSource == 0);
+    nextFrame();
+    return true;
+}
+
+// Current frame, from the loader if there is one. Waiting for the loader
+// counts as an underrun.
+const char* FileThread::frame()
+{
+    if (mSource == 0)
+        return mData + mFrameIndex * mFrameSize;
+
+    bool waited;
+    const char *p = mSource->acquire(waited);
+    if (waited)
+        accountUnderrun();
+    if (p == 0)
+        LOGE("\"%s\" frame %u not available", mSpec->name.c_str(),
+                (unsigned int)mFrameIndex);
+    return p;
+}
+
+void FileThread::nextFrame()
+{
+    if (mSource != 0)
+        mSource->release();
+    mFrameIndex = (mFrameIndex + 1) % mFrames;
+}
+
 void FileThread::updateContent()
 {
     sp<Surface> s = mSurfaceControl->getSurface();
 
     if (mSpec->renderFlag(RenderFlags::GL)) {
+        const uint64_t texBytes = mRenderer != 0 ? mRenderer->frameBytes() :
+                mSpec->srcGeometry.width * mSpec->srcGeometry.height * mBpp;
+
         if (mWidth != mLastWidth || mHeight != mLastHeight) {
             // Render once with the old dimensions
-            glBindTexture(GL_TEXTURE_2D, mTIds.at(mFrameIndex));
-            glDrawTexiOES(0, 0, 0, mLastWidth, mLastHeight);
-            eglSwapBuffers(mEglDisplay, mEglSurface);
+            drawFrame(mLastWidth, mLastHeight);
+            swapBuffers();
+            accountBytes(texBytes, mLastWidth * mLastHeight * bufferBpp());
 
             // Purge buffers
             if (!TestBase::purgeEglBuffers()) {
@@ -262,10 +494,22 @@ void FileThread::updateContent()
 
             glViewport(0, 0, mWidth, mHeight);
         }
-        glBindTexture(GL_TEXTURE_2D, mTIds.at(mFrameIndex));
-        glDrawTexiOES(0, 0, 0, mWidth, mHeight);
-        eglSwapBuffers(mEglDisplay, mEglSurface);
-    } else if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12) {
+        drawFrame(mWidth, mHeight);
+        swapBuffers();
+        accountBytes(texBytes, mWidth * mHeight * bufferBpp());
+        if (mData != 0)
+            verifyFrame(mFrameIndex, mData + mFrameIndex * mFrameSize, mFrameSize, true);
+        nextFrame();
+        return;
+    }
+
+    const char *data = frame(), *src = data;
+    if (src == 0) {
+        requestExit();
+        return;
+    }
+
+    if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12) {
         GraphicBufferMapper &mapper = GraphicBufferMapper::get();
         sp<ANativeWindow> window(s);
         ANativeWindowBuffer *b;
@@ -280,19 +524,20 @@ void FileThread::updateContent()
         unsigned int sl = mSpec->srcGeometry.stride, dl = b->stride;
         unsigned int h = min(mSpec->srcGeometry.height, b->height);
         unsigned int w = min(mSpec->srcGeometry.width, b->width);
-        char *src = mData + mFrameIndex * sl * mSpec->srcGeometry.height * 3 / 2;
         char *dst = y;
         for (unsigned int i = 0; i < h; i++, dst += dl, src += sl)
             memcpy(dst, src, w);
         dst = uv;
         for (unsigned int i = 0; i < h / 2; i++, dst += dl, src += sl)
             memcpy(dst, src, w);
+        accountBytes(w * (h + h / 2), w * (h + h / 2));
+        captureBuffer(y, uv, b->stride, b->width, b->height);
 
         mapper.unlock(b->handle);
         window.get()->queueBuffer(window.get(), b);
     } else {
         Surface::SurfaceInfo info;
-        if (s->lock(&info) != NO_ERROR) {
+        if (lockSurface(s, &info) != NO_ERROR) {
             LOGE("\"%s\" failed to lock surface", mSpec->name.c_str());
             requestExit();
             return;
@@ -302,16 +547,20 @@ void FileThread::updateContent()
         if (mLineByLine) {
             unsigned int sl = mSpec->srcGeometry.stride * mBpp, dl = info.s * mBpp;
             unsigned int h = min((unsigned int)mSpec->srcGeometry.height, info.h);
-            char* src = mData + mFrameIndex * sl * mSpec->srcGeometry.height;
             unsigned int b = min(sl, dl);
             for (unsigned int i = 0; i < h; i++, dst += dl, src += sl)
                 memcpy(dst, src, b);
+            accountBytes(h * b, h * b);
         } else {
-           memcpy(dst, mData + mFrameIndex * mFrameSize, mFrameSize);
+           memcpy(dst, src, mFrameSize);
+           accountBytes(mFrameSize, mFrameSize);
         }
+        captureBuffer(reinterpret_cast<char*>(info.bits), 0, info.s, info.w, info.h);
 
         s->unlockAndPost();
     }
 
-    mFrameIndex = (mFrameIndex + 1) % mFrames;
+    // Mapped frames stay put, loaded ones are reused once released
+    verifyFrame(mFrameIndex, data, mFrameSize, mSource == 0);
+    nextFrame();
 }
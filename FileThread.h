@@ -35,32 +35,48 @@
 
 #include <vector>
 
+#include "FrameSource.h"
 #include "TestBase.h"
 
 using namespace android;
 
+class Gles2Renderer;
+
 class FileThread : public TestBase {
     public:
         FileThread(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
                 Mutex &exitLock, Condition &exitCondition);
         ~FileThread();
-        virtual status_t readyToRun();
+
+        // Bytes in one frame of the spec's clip, from src geometry and format
+        static size_t frameSize(const sp<SurfaceSpec>& spec);
 
     protected:
+        virtual status_t prepare();
         virtual void updateContent();
+        virtual bool fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+                uint64_t& read, uint64_t& written);
 
     private:
-        bool initTexture(void* p);
+        bool mapFile();
+        const char* frame();
+        void nextFrame();
+        bool initTexture(const void* p);
+        bool initTextures();
+        void drawFrame(int width, int height);
 
         int mFd;
         char* mData;
+        FrameSource *mSource;   // Frames loaded or decoded ahead instead of mapped, if set
         size_t mLength;
+        size_t mMapLength;
         size_t mFrameSize;
         size_t mFrames;
         size_t mFrameIndex;
         bool mLineByLine;
         int mBpp;
         vector<GLuint> mTIds;
+        Gles2Renderer *mRenderer;   // Set for GLES2, drawing instead of mTIds
 };
 
 #endif
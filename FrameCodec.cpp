@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FrameCodec.h"
+#include "LocalTypes.h"
+
+using namespace std;
+
+// Control bytes: 0x00-0x7f a literal of c + 1 bytes, 0x80-0xfe a run of
+// c - 0x80 + 3 copies of the next byte, 0xff a run of 130 + varint copies
+#define MAX_LITERAL     128
+#define MIN_RUN         3
+#define MAX_SHORT_RUN   129
+#define LONG_RUN        0xff
+
+bool FrameCodec::isCoded(string path)
+{
+    CodecHeader h;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool coded = read(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) && h.magic == CODEC_MAGIC;
+    close(fd);
+    return coded;
+}
+
+// Band edges are cache line aligned so parallel decoders don't share lines
+void FrameCodec::bandRange(size_t frameSize, unsigned int bands, unsigned int b,
+        size_t& start, size_t& end)
+{
+    start = b == 0 ? 0 : ((uint64_t)frameSize * b / bands) & ~(size_t)63;
+    end = b == bands - 1 ? frameSize : ((uint64_t)frameSize * (b + 1) / bands) & ~(size_t)63;
+}
+
+static void putLiteral(const uint8_t *d, size_t start, size_t end, vector<uint8_t>& out)
+{
+    while (start < end) {
+        size_t n = min(end - start, (size_t)MAX_LITERAL);
+        out.push_back(n - 1);
+        out.insert(out.end(), d + start, d + start + n);
+        start += n;
+    }
+}
+
+static void putRun(uint8_t v, size_t n, vector<uint8_t>& out)
+{
+    if (n <= MAX_SHORT_RUN) {
+        out.push_back(0x80 + n - MIN_RUN);
+    } else {
+        out.push_back(LONG_RUN);
+        for (n -= MAX_SHORT_RUN + 1; n >= 0x80; n >>= 7)
+            out.push_back(0x80 | (n & 0x7f));
+        out.push_back(n);
+    }
+    out.push_back(v);
+}
+
+void FrameCodec::pack(const uint8_t *cur, const uint8_t *prev, size_t len,
+        vector<uint8_t>& out)
+{
+    vector<uint8_t> delta(cur, cur + len);
+    if (prev != NULL) {
+        for (size_t i = 0; i < len; i++)
+            delta[i] ^= prev[i];
+    }
+
+    const uint8_t *d = len > 0 ? &delta[0] : NULL;
+    size_t literal = 0, i = 0;
+    while (i < len) {
+        size_t j = i + 1;
+        while (j < len && d[j] == d[i])
+            j++;
+        if (j - i >= MIN_RUN) {
+            putLiteral(d, literal, i, out);
+            putRun(d[i], j - i, out);
+            literal = j;
+        }
+        i = j;
+    }
+    putLiteral(d, literal, len, out);
+}
+
+bool FrameCodec::unpack(const uint8_t *in, size_t inLen, const uint8_t *prev,
+        uint8_t *out, size_t len)
+{
+    const uint8_t *end = in + inLen;
+    uint8_t *o = out, *oend = out + len;
+
+    while (o < oend) {
+        if (in >= end)
+            return false;
+
+        size_t n;
+        uint8_t c = *in++;
+        if (c < 0x80) {
+            n = c + 1;
+            if (n > (size_t)(end - in) || n > (size_t)(oend - o))
+                return false;
+            if (prev == NULL) {
+                memcpy(o, in, n);
+            } else {
+                for (size_t k = 0; k < n; k++)
+                    o[k] = prev[k] ^ in[k];
+            }
+            in += n;
+        } else {
+            if (c == LONG_RUN) {
+                size_t extra = 0;
+                int shift = 0;
+                do {
+                    if (in >= end || shift > 28)
+                        return false;
+                    extra |= (size_t)(*in & 0x7f) << shift;
+                    shift += 7;
+                } while (*in++ & 0x80);
+                n = MAX_SHORT_RUN + 1 + extra;
+            } else {
+                n = c - 0x80 + MIN_RUN;
+            }
+            if (in >= end || n > (size_t)(oend - o))
+                return false;
+
+            uint8_t v = *in++;
+            if (prev == NULL) {
+                memset(o, v, n);
+            } else if (v == 0) {
+                memcpy(o, prev, n);   // Unchanged since the previous frame
+            } else {
+                for (size_t k = 0; k < n; k++)
+                    o[k] = prev[k] ^ v;
+            }
+        }
+
+        o += n;
+        if (prev != NULL)
+            prev += n;
+    }
+
+    return in == end;
+}
+
+bool FrameCodec::encode(string in, string out, size_t frameSize, unsigned int bands)
+{
+    int fd = open(in.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOGE("unable to open '%s' for reading", in.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || frameSize == 0 || st.st_size == 0 ||
+            st.st_size % frameSize != 0) {
+        LOGE("'%s' doesn't contain an integer number of %u byte frames", in.c_str(),
+                frameSize);
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    const uint8_t *data = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOGE("unable to map '%s': %s", in.c_str(), strerror(errno));
+        return false;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    if (bands < 1)
+        bands = 1;
+    if (bands > frameSize / 64 + 1)
+        bands = frameSize / 64 + 1;
+
+    CodecHeader h;
+    h.magic = CODEC_MAGIC;
+    h.version = CODEC_VERSION;
+    h.frameSize = frameSize;
+    h.frames = size / frameSize;
+    h.bands = bands;
+    h.reserved = 0;
+
+    string tmp = out + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) {
+        LOGE("unable to open '%s' for writing", tmp.c_str());
+        munmap((void*)data, size);
+        return false;
+    }
+
+    vector<uint64_t> offsets(h.frames + 1, 0);
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+        fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), f) == offsets.size();
+
+    vector<uint32_t> sizes(bands);
+    vector<uint8_t> packed;
+    uint64_t pos = sizeof(h) + offsets.size() * sizeof(uint64_t);
+    for (uint32_t i = 0; i < h.frames && ok; i++) {
+        const uint8_t *cur = data + (size_t)i * frameSize;
+        const uint8_t *prev = i > 0 ? cur - frameSize : NULL;
+
+        packed.clear();
+        for (unsigned int b = 0; b < bands; b++) {
+            size_t start, end, before = packed.size();
+            bandRange(frameSize, bands, b, start, end);
+            pack(cur + start, prev != NULL ? prev + start : NULL, end - start, packed);
+            sizes[b] = packed.size() - before;
+        }
+
+        // Keep the next frame's band sizes aligned
+        packed.resize((packed.size() + 3) & ~3, 0);
+
+        offsets[i] = pos;
+        ok = fwrite(&sizes[0], sizeof(uint32_t), bands, f) == bands &&
+            (packed.empty() || fwrite(&packed[0], 1, packed.size(), f) == packed.size());
+        pos += bands * sizeof(uint32_t) + packed.size();
+    }
+    offsets[h.frames] = pos;
+
+    ok = ok && fseek(f, sizeof(h), SEEK_SET) == 0 &&
+        fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), f) == offsets.size();
+    ok = fclose(f) == 0 && ok;
+    munmap((void*)data, size);
+
+    if (!ok || rename(tmp.c_str(), out.c_str()) != 0) {
+        LOGE("unable to write '%s': %s", out.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    LOGI("encoded '%s' to '%s', %u frames in %u bands, %llu -> %llu bytes", in.c_str(),
+            out.c_str(), h.frames, bands, (unsigned long long)size, (unsigned long long)pos);
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FRAME_CODEC_H
+#define _FRAME_CODEC_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Lossless codec for raw clips. Each frame is XOR'ed with the previous one
+// and run length packed, so static parts of a clip cost next to nothing. A
+// frame is split into bands that are packed independently, letting bands
+// be decoded in parallel. The first frame is packed against zeros.
+//
+// File layout, all little endian:
+//   CodecHeader
+//   uint64_t offsets[frames + 1]   file offset of each frame, and of the end
+//   per frame: uint32_t bandSizes[bands], then the packed bands in order,
+//              padded to a multiple of 4 bytes
+class FrameCodec
+{
+    public:
+        struct CodecHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t frameSize;
+            uint32_t frames;
+            uint32_t bands;
+            uint32_t reserved;
+        };
+
+        static bool isCoded(std::string path);
+        static bool encode(std::string in, std::string out, size_t frameSize,
+                unsigned int bands);
+
+        // Bytes [start, end) of band b
+        static void bandRange(size_t frameSize, unsigned int bands, unsigned int b,
+                size_t& start, size_t& end);
+
+        // prev is NULL for a frame packed against zeros
+        static void pack(const uint8_t *cur, const uint8_t *prev, size_t len,
+                std::vector<uint8_t>& out);
+        static bool unpack(const uint8_t *in, size_t inLen, const uint8_t *prev,
+                uint8_t *out, size_t len);
+};
+
+#define CODEC_MAGIC     0x43544441  // "ADTC"
+#define CODEC_VERSION   1
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FrameDecoder.h"
+#include "LocalTypes.h"
+
+using namespace android;
+using namespace std;
+
+FrameDecoder::FrameDecoder(string name) :
+    mName(name), mData(NULL), mSize(0), mOffsets(NULL), mFrames(0), mDepth(0),
+    mReleased(0), mStopping(false), mFailed(false)
+{
+    memset(&mHeader, 0, sizeof(mHeader));
+}
+
+FrameDecoder::~FrameDecoder()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    for (size_t i = 0; i < mWorkers.size(); i++)
+        mWorkers[i]->requestExitAndWait();
+
+    for (size_t i = 0; i < mSlots.size(); i++)
+        free(mSlots[i]);
+    if (mData != NULL)
+        munmap((void*)mData, mSize);
+}
+
+bool FrameDecoder::open(string path, size_t frameSize)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOGE("\"%s\" can't open '%s'", mName.c_str(), path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(mHeader)) {
+        LOGE("\"%s\" '%s' is too short for a coded clip", mName.c_str(), path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    mSize = st.st_size;
+    void *p = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        LOGE("\"%s\" mmap failed '%s': %s", mName.c_str(), path.c_str(), strerror(errno));
+        return false;
+    }
+    mData = (const uint8_t*)p;
+
+    memcpy(&mHeader, mData, sizeof(mHeader));
+    if (mHeader.magic != CODEC_MAGIC || mHeader.version != CODEC_VERSION) {
+        LOGE("\"%s\" '%s' is not a coded clip of version %d", mName.c_str(), path.c_str(),
+                CODEC_VERSION);
+        return false;
+    }
+    if (mHeader.frameSize != frameSize) {
+        LOGE("\"%s\" '%s' has %u byte frames, geometry and format give %u", mName.c_str(),
+                path.c_str(), mHeader.frameSize, (unsigned int)frameSize);
+        return false;
+    }
+
+    // Every frame must lie within the file, with room for its band sizes.
+    // The frame count is checked against the size before it is multiplied,
+    // so that a huge one can't wrap the table end around (mSize is at least
+    // the header, see above).
+    mOffsets = (const uint64_t*)(mData + sizeof(mHeader));
+    bool ok = mHeader.frames > 0 && mHeader.bands > 0 &&
+        mHeader.frames < (mSize - sizeof(mHeader)) / sizeof(uint64_t);
+    size_t tableEnd = ok ? sizeof(mHeader) + (mHeader.frames + 1) * sizeof(uint64_t) : 0;
+    ok = ok && mOffsets[mHeader.frames] <= mSize;
+    for (uint32_t i = 0; ok && i < mHeader.frames; i++)
+        ok = mOffsets[i] >= tableEnd && mOffsets[i] % 4 == 0 &&
+            mOffsets[i] + mHeader.bands * sizeof(uint32_t) <= mOffsets[i + 1];
+    if (!ok) {
+        LOGE("\"%s\" '%s' has a corrupt frame table", mName.c_str(), path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+size_t FrameDecoder::frames()
+{
+    return mHeader.frames;
+}
+
+bool FrameDecoder::start(size_t frames, unsigned int depth, unsigned int threads)
+{
+    mFrames = min(frames, (size_t)mHeader.frames);
+    mDepth = max(depth, 2u);    // The previous frame is the reference
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+    threads = min(threads, mHeader.bands);
+
+    for (unsigned int i = 0; i < mDepth; i++) {
+        void *p = NULL;
+        if (posix_memalign(&p, 64, mHeader.frameSize) != 0) {
+            LOGE("\"%s\" can't allocate %u byte frame", mName.c_str(), mHeader.frameSize);
+            return false;
+        }
+        mSlots.push_back((uint8_t*)p);
+    }
+
+    mProgress.assign(threads, 0);
+    for (unsigned int i = 0; i < threads; i++) {
+        sp<Worker> w = new Worker(this, i);
+        if (w->run("adtf decoder") != NO_ERROR) {
+            LOGE("\"%s\" failed to start decoder thread", mName.c_str());
+            return false;
+        }
+        mWorkers.push_back(w);
+    }
+
+    LOGD("\"%s\" decoding %u frames in %u bands, %u ahead on %u threads", mName.c_str(),
+            (unsigned int)mFrames, mHeader.bands, mDepth, threads);
+    return true;
+}
+
+// Frames every worker has finished
+uint64_t FrameDecoder::completed()
+{
+    uint64_t done = mProgress[0];
+    for (size_t i = 1; i < mProgress.size(); i++)
+        done = min(done, mProgress[i]);
+    return done;
+}
+
+bool FrameDecoder::decodeNext(unsigned int worker)
+{
+    uint64_t n;
+    {
+        Mutex::Autolock _l(mLock);
+        n = mProgress[worker];
+        while (n >= mReleased + mDepth && !mStopping)
+            mCondition.wait(mLock);
+        if (mStopping)
+            return false;
+    }
+
+    // Each loop over the clip restarts at frame 0, packed against zeros
+    size_t frame = n % mFrames;
+    uint8_t *out = mSlots[n % mDepth];
+    const uint8_t *prev = frame == 0 ? NULL : mSlots[(n - 1) % mDepth];
+
+    const uint8_t *base = mData + mOffsets[frame];
+    const uint32_t *sizes = (const uint32_t*)base;
+    const uint8_t *in = base + mHeader.bands * sizeof(uint32_t);
+    const uint8_t *end = mData + mOffsets[frame + 1];
+
+    bool ok = true;
+    for (unsigned int b = 0; b < mHeader.bands && ok; b++) {
+        if (sizes[b] > (size_t)(end - in)) {
+            ok = false;
+            break;
+        }
+        if (b % mProgress.size() == worker) {
+            size_t start, stop;
+            FrameCodec::bandRange(mHeader.frameSize, mHeader.bands, b, start, stop);
+            ok = FrameCodec::unpack(in, sizes[b], prev != NULL ? prev + start : NULL,
+                    out + start, stop - start);
+        }
+        in += sizes[b];
+    }
+
+    Mutex::Autolock _l(mLock);
+    if (!ok) {
+        LOGE("\"%s\" frame %u is corrupt", mName.c_str(), (unsigned int)frame);
+        mFailed = true;
+        mCondition.broadcast();
+        return false;
+    }
+    mProgress[worker] = n + 1;
+    mCondition.broadcast();
+    return true;
+}
+
+const char* FrameDecoder::acquire(bool& waited)
+{
+    Mutex::Autolock _l(mLock);
+
+    waited = false;
+    while (completed() <= mReleased && !mFailed) {
+        waited = true;
+        mCondition.wait(mLock);
+    }
+    if (completed() <= mReleased)
+        return NULL;
+    return (const char*)mSlots[mReleased % mDepth];
+}
+
+void FrameDecoder::release()
+{
+    Mutex::Autolock _l(mLock);
+    mReleased++;
+    mCondition.broadcast();
+}
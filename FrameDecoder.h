@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FRAME_DECODER_H
+#define _FRAME_DECODER_H
+
+#include <string>
+#include <vector>
+#include <utils/threads.h>
+
+#include "FrameCodec.h"
+#include "FrameSource.h"
+
+using namespace android;
+
+// Decodes a FrameCodec clip ahead of use into a ring of frames. Each worker
+// owns a fixed set of bands and decodes them frame after frame, so the only
+// thing workers wait for is a free slot in the ring: a band's reference is
+// the same band of the previous frame, which the same worker wrote.
+class FrameDecoder : public FrameSource {
+    public:
+        FrameDecoder(std::string name);
+        virtual ~FrameDecoder();
+
+        bool open(std::string path, size_t frameSize);
+        size_t frames();
+
+        // Loops over the first frames of the clip, decoding up to depth
+        // frames ahead on threads workers, 0 for one per CPU
+        bool start(size_t frames, unsigned int depth, unsigned int threads);
+
+        virtual const char* acquire(bool& waited);
+        virtual void release();
+
+    private:
+        class Worker : public Thread {
+            public:
+                Worker(FrameDecoder *decoder, unsigned int index) :
+                    Thread(false), mDecoder(decoder), mIndex(index) {}
+            private:
+                virtual bool threadLoop() { return mDecoder->decodeNext(mIndex); }
+                FrameDecoder *mDecoder;
+                unsigned int mIndex;
+        };
+
+        bool decodeNext(unsigned int worker);
+        uint64_t completed();
+
+        std::string mName;
+        const uint8_t *mData;
+        size_t mSize;
+        FrameCodec::CodecHeader mHeader;
+        const uint64_t *mOffsets;
+
+        size_t mFrames;
+        unsigned int mDepth;
+        std::vector<uint8_t*> mSlots;
+        std::vector<sp<Worker> > mWorkers;
+
+        Mutex mLock;
+        Condition mCondition;
+        std::vector<uint64_t> mProgress;    // Frames each worker has finished
+        uint64_t mReleased;                 // Frames handed out and released
+        bool mStopping;
+        bool mFailed;
+};
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "FrameLoader.h"
+#include "LocalTypes.h"
+
+using namespace android;
+using namespace std;
+
+// io_uring ABI, declared here since platform headers don't have it
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup     425
+#define __NR_io_uring_enter     426
+#endif
+
+#define URING_OP_READV          1
+#define URING_ENTER_GETEVENTS   1
+#define URING_OFF_SQ_RING       0ULL
+#define URING_OFF_CQ_RING       0x8000000ULL
+#define URING_OFF_SQES          0x10000000ULL
+
+struct UringSqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t rwFlags;
+    uint64_t userData;
+    uint64_t pad[3];
+};
+
+struct UringCqe {
+    uint64_t userData;
+    int32_t res;
+    uint32_t flags;
+};
+
+struct UringSqOffsets {
+    uint32_t head, tail, ringMask, ringEntries, flags, dropped, array, resv1;
+    uint64_t resv2;
+};
+
+struct UringCqOffsets {
+    uint32_t head, tail, ringMask, ringEntries, overflow, cqes, flags, resv1;
+    uint64_t resv2;
+};
+
+struct UringParams {
+    uint32_t sqEntries, cqEntries, flags, sqThreadCpu, sqThreadIdle;
+    uint32_t features, wqFd, resv[3];
+    UringSqOffsets sqOff;
+    UringCqOffsets cqOff;
+};
+
+// O_DIRECT wants buffers, offsets and lengths in whole logical blocks
+#define DIRECT_ALIGN 4096
+
+static size_t alignUp(size_t v)
+{
+    return (v + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+}
+
+FrameLoader::FrameLoader(string name) :
+    mName(name), mFd(-1), mFrameSize(0), mFrames(0), mBufferSize(0), mHead(0),
+    mRing(-1), mSqMap(MAP_FAILED), mSqMapSize(0), mCqMap(MAP_FAILED), mCqMapSize(0),
+    mSqes(MAP_FAILED), mSqesSize(0), mSqTail(0), mSqMask(0), mSqArray(0), mCqHead(0),
+    mCqTail(0), mCqMask(0), mCqes(0), mInFlight(0), mNextRead(0), mStopping(false)
+{
+}
+
+FrameLoader::~FrameLoader()
+{
+    if (mReader != 0) {
+        {
+            Mutex::Autolock _l(mLock);
+            mStopping = true;
+            mCondition.broadcast();
+        }
+        mReader->requestExitAndWait();
+    }
+
+    // The kernel may still be writing to the buffers
+    while (mRing >= 0 && mInFlight > 0) {
+        if (syscall(__NR_io_uring_enter, mRing, 0, 1, URING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR)
+            break;
+        reap();
+    }
+
+    if (mSqes != MAP_FAILED)
+        munmap(mSqes, mSqesSize);
+    if (mCqMap != MAP_FAILED && mCqMap != mSqMap)
+        munmap(mCqMap, mCqMapSize);
+    if (mSqMap != MAP_FAILED)
+        munmap(mSqMap, mSqMapSize);
+    if (mRing >= 0)
+        close(mRing);
+
+    for (size_t i = 0; i < mSlots.size(); i++)
+        free(mSlots[i].buffer);
+    if (mFd >= 0)
+        close(mFd);
+}
+
+bool FrameLoader::open(const char *path, size_t frameSize, size_t frames, unsigned int depth)
+{
+    mFd = ::open(path, O_RDONLY | O_DIRECT);
+    if (mFd < 0) {
+        LOGW("\"%s\" no O_DIRECT for '%s', reading through the page cache",
+                mName.c_str(), path);
+        mFd = ::open(path, O_RDONLY);
+    }
+    if (mFd < 0) {
+        LOGE("\"%s\" can't open '%s': %s", mName.c_str(), path, strerror(errno));
+        return false;
+    }
+
+    mFrameSize = frameSize;
+    mFrames = frames;
+    if (depth > frames)
+        depth = frames;
+
+    // A frame may start anywhere within a block, so allow one extra
+    mBufferSize = alignUp(frameSize + DIRECT_ALIGN);
+    mSlots.resize(depth);
+    for (size_t i = 0; i < depth; i++) {
+        Slot& slot = mSlots[i];
+        void *p = 0;
+        if (posix_memalign(&p, DIRECT_ALIGN, mBufferSize) != 0) {
+            LOGE("\"%s\" can't allocate %llu byte frame buffer", mName.c_str(),
+                    (unsigned long long)mBufferSize);
+            return false;
+        }
+        slot.buffer = (char*)p;
+        slot.frame = i;
+        slot.state = FREE;
+        prepare(slot);
+    }
+
+    if (setupUring()) {
+        for (size_t i = 0; i < mSlots.size(); i++)
+            submit(i);
+        LOGD("\"%s\" loading %u frames ahead with io_uring", mName.c_str(), depth);
+        return true;
+    }
+
+    mReader = new Reader(this);
+    if (mReader->run("adtf loader") != NO_ERROR) {
+        LOGE("\"%s\" failed to start frame reader", mName.c_str());
+        mReader.clear();
+        return false;
+    }
+    LOGD("\"%s\" loading %u frames ahead with pread", mName.c_str(), depth);
+    return true;
+}
+
+bool FrameLoader::usingUring()
+{
+    return mRing >= 0;
+}
+
+// Aligned read covering the slot's frame
+void FrameLoader::prepare(Slot& slot)
+{
+    off_t pos = (off_t)slot.frame * mFrameSize;
+    slot.start = pos & ~(off_t)(DIRECT_ALIGN - 1);
+    slot.skip = pos - slot.start;
+    slot.iov.iov_base = slot.buffer;
+    slot.iov.iov_len = alignUp(slot.skip + mFrameSize);
+}
+
+// The read may end short at end of file, but must cover the frame
+bool FrameLoader::complete(Slot& slot, ssize_t res)
+{
+    if (res < (ssize_t)(slot.skip + mFrameSize)) {
+        LOGE("\"%s\" read of frame %u failed: %s", mName.c_str(), (unsigned int)slot.frame,
+                res < 0 ? strerror(-res) : "short read");
+        slot.state = FAILED;
+        return false;
+    }
+    slot.state = READY;
+    return true;
+}
+
+bool FrameLoader::setupUring()
+{
+    UringParams p;
+    memset(&p, 0, sizeof(p));
+
+    mRing = syscall(__NR_io_uring_setup, mSlots.size(), &p);
+    if (mRing < 0) {
+        LOGD("\"%s\" no io_uring: %s", mName.c_str(), strerror(errno));
+        return false;
+    }
+
+    mSqMapSize = p.sqOff.array + p.sqEntries * sizeof(uint32_t);
+    mCqMapSize = p.cqOff.cqes + p.cqEntries * sizeof(UringCqe);
+    mSqesSize = p.sqEntries * sizeof(UringSqe);
+
+    mSqMap = mmap(NULL, mSqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            mRing, URING_OFF_SQ_RING);
+    mCqMap = mmap(NULL, mCqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            mRing, URING_OFF_CQ_RING);
+    mSqes = mmap(NULL, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            mRing, URING_OFF_SQES);
+    if (mSqMap == MAP_FAILED || mCqMap == MAP_FAILED || mSqes == MAP_FAILED) {
+        LOGW("\"%s\" can't map io_uring: %s", mName.c_str(), strerror(errno));
+        close(mRing);
+        mRing = -1;
+        return false;
+    }
+
+    char *sq = (char*)mSqMap, *cq = (char*)mCqMap;
+    mSqTail = (unsigned int*)(sq + p.sqOff.tail);
+    mSqMask = *(unsigned int*)(sq + p.sqOff.ringMask);
+    mSqArray = (unsigned int*)(sq + p.sqOff.array);
+    mCqHead = (unsigned int*)(cq + p.cqOff.head);
+    mCqTail = (unsigned int*)(cq + p.cqOff.tail);
+    mCqMask = *(unsigned int*)(cq + p.cqOff.ringMask);
+    mCqes = cq + p.cqOff.cqes;
+    return true;
+}
+
+// At most one read per slot is in flight, so the rings never fill up
+void FrameLoader::submit(size_t index)
+{
+    Slot& slot = mSlots[index];
+    unsigned int tail = *mSqTail;
+    unsigned int i = tail & mSqMask;
+    UringSqe *sqe = (UringSqe*)mSqes + i;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = URING_OP_READV;
+    sqe->fd = mFd;
+    sqe->off = slot.start;
+    sqe->addr = (uint64_t)(uintptr_t)&slot.iov;
+    sqe->len = 1;
+    sqe->userData = index;
+    mSqArray[i] = i;
+
+    // The entry must be visible before the tail moves
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+
+    slot.state = PENDING;
+    mInFlight++;
+    if (syscall(__NR_io_uring_enter, mRing, 1, 0, 0, NULL, 0) < 0) {
+        LOGE("\"%s\" io_uring submit failed: %s", mName.c_str(), strerror(errno));
+        slot.state = FAILED;
+        mInFlight--;
+    }
+}
+
+void FrameLoader::reap()
+{
+    // The kernel fills an entry before moving the tail past it, and reuses
+    // it once the head has moved past it
+    unsigned int head = *mCqHead;
+    unsigned int tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        UringCqe *cqe = (UringCqe*)mCqes + (head & mCqMask);
+        if (cqe->userData < mSlots.size()) {
+            complete(mSlots[cqe->userData], cqe->res);
+            mInFlight--;
+        }
+        head++;
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+}
+
+bool FrameLoader::readNext()
+{
+    Slot *slot;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mSlots[mNextRead].state != FREE && !mStopping)
+            mCondition.wait(mLock);
+        if (mStopping)
+            return false;
+        slot = &mSlots[mNextRead];
+        slot->state = PENDING;
+        mNextRead = (mNextRead + 1) % mSlots.size();
+    }
+
+    ssize_t done = 0, want = slot->iov.iov_len;
+    while (done < want) {
+        ssize_t n = pread(mFd, slot->buffer + done, want - done, slot->start + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            done = -errno;
+            break;
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+
+    Mutex::Autolock _l(mLock);
+    complete(*slot, done);
+    mCondition.broadcast();
+    return true;
+}
+
+const char* FrameLoader::acquire(bool& waited)
+{
+    Slot& slot = mSlots[mHead];
+    waited = false;
+
+    if (mRing >= 0) {
+        reap();
+        while (slot.state == PENDING) {
+            waited = true;
+            if (syscall(__NR_io_uring_enter, mRing, 0, 1, URING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                    errno != EINTR) {
+                LOGE("\"%s\" io_uring wait failed: %s", mName.c_str(), strerror(errno));
+                return NULL;
+            }
+            reap();
+        }
+    } else {
+        Mutex::Autolock _l(mLock);
+        while (slot.state == FREE || slot.state == PENDING) {
+            waited = true;
+            mCondition.wait(mLock);
+        }
+    }
+
+    return slot.state == READY ? slot.buffer + slot.skip : NULL;
+}
+
+// Reuses the slot for the frame depth frames further on
+void FrameLoader::release()
+{
+    Slot& slot = mSlots[mHead];
+    size_t index = mHead;
+    mHead = (mHead + 1) % mSlots.size();
+
+    if (mRing >= 0) {
+        slot.frame = (slot.frame + mSlots.size()) % mFrames;
+        prepare(slot);
+        submit(index);
+        return;
+    }
+
+    Mutex::Autolock _l(mLock);
+    slot.frame = (slot.frame + mSlots.size()) % mFrames;
+    prepare(slot);
+    slot.state = FREE;
+    mCondition.broadcast();
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FRAME_LOADER_H
+#define _FRAME_LOADER_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <utils/threads.h>
+
+#include "FrameSource.h"
+
+using namespace android;
+
+// Reads a raw clip a number of frames ahead into a ring of aligned buffers,
+// bypassing the page cache with O_DIRECT where the file system allows it.
+// Reads go through io_uring when the kernel has it, otherwise a reader
+// thread does them with pread.
+class FrameLoader : public FrameSource {
+    public:
+        FrameLoader(std::string name);
+        virtual ~FrameLoader();
+
+        bool open(const char *path, size_t frameSize, size_t frames, unsigned int depth);
+        bool usingUring();
+
+        virtual const char* acquire(bool& waited);
+        virtual void release();
+
+    private:
+        enum State {
+            FREE,
+            PENDING,
+            READY,
+            FAILED,
+        };
+
+        struct Slot {
+            size_t frame;
+            char *buffer;
+            off_t start;        // Aligned file offset of the read
+            size_t skip;        // Frame offset within the buffer
+            struct iovec iov;
+            State state;
+        };
+
+        class Reader : public Thread {
+            public:
+                Reader(FrameLoader *loader) : Thread(false), mLoader(loader) {}
+            private:
+                virtual bool threadLoop() { return mLoader->readNext(); }
+                FrameLoader *mLoader;
+        };
+
+        void prepare(Slot& slot);
+        bool complete(Slot& slot, ssize_t res);
+
+        bool setupUring();
+        void submit(size_t index);
+        void reap();
+        bool readNext();
+
+        std::string mName;
+        int mFd;
+        size_t mFrameSize;
+        size_t mFrames;
+        size_t mBufferSize;
+        std::vector<Slot> mSlots;
+        size_t mHead;           // Slot handed out next
+
+        // io_uring
+        int mRing;
+        void *mSqMap;
+        size_t mSqMapSize;
+        void *mCqMap;
+        size_t mCqMapSize;
+        void *mSqes;
+        size_t mSqesSize;
+        volatile unsigned int *mSqTail;
+        unsigned int mSqMask;
+        unsigned int *mSqArray;
+        volatile unsigned int *mCqHead;
+        volatile unsigned int *mCqTail;
+        unsigned int mCqMask;
+        void *mCqes;
+        unsigned int mInFlight;
+
+        // pread fallback
+        sp<Reader> mReader;
+        Mutex mLock;
+        Condition mCondition;
+        size_t mNextRead;
+        bool mStopping;
+};
+
+#endif
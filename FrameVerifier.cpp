@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "FrameVerifier.h"
+#include "LocalTypes.h"
+
+using namespace android;
+using namespace std;
+
+// CRC32C (Castagnoli, reflected). Hardware CRC instructions are used where
+// the CPU has them, slicing-by-8 tables otherwise.
+#define CRC32C_POLY 0x82f63b78
+
+typedef uint32_t (*CrcFunc)(uint32_t crc, const uint8_t *p, size_t len);
+
+static uint32_t sTable[8][256];
+static CrcFunc sCrc;
+static pthread_once_t sCrcOnce = PTHREAD_ONCE_INIT;
+
+static uint32_t crcTable(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = sTable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo = crc ^ *(const uint32_t*)p;
+        uint32_t hi = *(const uint32_t*)(p + 4);
+        crc = sTable[7][lo & 0xff] ^ sTable[6][(lo >> 8) & 0xff] ^
+            sTable[5][(lo >> 16) & 0xff] ^ sTable[4][lo >> 24] ^
+            sTable[3][hi & 0xff] ^ sTable[2][(hi >> 8) & 0xff] ^
+            sTable[1][(hi >> 16) & 0xff] ^ sTable[0][hi >> 24];
+    }
+    while (len-- > 0)
+        crc = sTable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crcSse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+#if defined(__x86_64__)
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8)
+        c = _mm_crc32_u64(c, *(const uint64_t*)p);
+    crc = (uint32_t)c;
+#else
+    for (; len >= 4; len -= 4, p += 4)
+        crc = _mm_crc32_u32(crc, *(const uint32_t*)p);
+#endif
+    while (len-- > 0)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+static uint32_t crcArm(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = __crc32cb(crc, *p++);
+        len--;
+    }
+    for (; len >= 8; len -= 8, p += 8)
+        crc = __crc32cd(crc, *(const uint64_t*)p);
+    while (len-- > 0)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+static void initCrc()
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        sTable[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            sTable[t][i] = sTable[0][sTable[t - 1][i] & 0xff] ^ (sTable[t - 1][i] >> 8);
+
+    sCrc = crcTable;
+#if defined(__i386__) || defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+        sCrc = crcSse42;
+#elif defined(__ARM_FEATURE_CRC32)
+    sCrc = crcArm;
+#endif
+}
+
+uint32_t FrameVerifier::crc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&sCrcOnce, initCrc);
+    return ~sCrc(~crc, (const uint8_t*)data, len);
+}
+
+FrameVerifier::FrameVerifier(string name, unsigned int snapshots) :
+    Thread(false), mName(name), mRecording(false), mMaxPending(max(snapshots, 1u) * 2),
+    mStopping(false), mHashed(0), mDropped(0), mMismatches(0), mBacklogMax(0)
+{
+    pthread_once(&sCrcOnce, initCrc);
+
+    // Snapshot buffers are sized by the first frames that need them
+    mSnapshots.resize(max(snapshots, 1u));
+    for (size_t i = 0; i < mSnapshots.size(); i++)
+        mFree.push_back(i);
+}
+
+FrameVerifier::~FrameVerifier()
+{
+}
+
+bool FrameVerifier::setManifest(string path)
+{
+    mManifestPath = path;
+
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+        if (errno != ENOENT) {
+            LOGE("\"%s\" unable to open manifest '%s': %s", mName.c_str(), path.c_str(),
+                    strerror(errno));
+            return false;
+        }
+        LOGD("\"%s\" recording manifest '%s'", mName.c_str(), path.c_str());
+        mRecording = true;
+        return true;
+    }
+
+    char line[128];
+    unsigned int n = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        n++;
+        unsigned long long index;
+        unsigned int crc;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%llu %x", &index, &crc) != 2) {
+            LOGW("%s:%u invalid manifest line", path.c_str(), n);
+            continue;
+        }
+        mManifest[index] = crc;
+    }
+    fclose(f);
+
+    LOGD("\"%s\" verifying against %u frames from '%s'", mName.c_str(),
+            (unsigned int)mManifest.size(), path.c_str());
+    return true;
+}
+
+void FrameVerifier::submit(uint64_t index, const void *data, size_t len, bool stable)
+{
+    Job job;
+    job.index = index;
+    job.data = (const uint8_t*)data;
+    job.len = len;
+    job.queued = systemTime();
+    job.snapshot = -1;
+
+    {
+        Mutex::Autolock _l(mLock);
+        if (mStopping)
+            return;
+        if (mJobs.size() >= mMaxPending || (!stable && mFree.empty())) {
+            mDropped++;
+            return;
+        }
+        if (!stable) {
+            job.snapshot = mFree.back();
+            mFree.pop_back();
+        }
+    }
+
+    // The snapshot is ours until the job is done, so copy without the lock
+    if (job.snapshot >= 0) {
+        vector<uint8_t>& s = mSnapshots[job.snapshot];
+        if (s.size() < len)
+            s.resize(len);
+        memcpy(&s[0], data, len);
+        job.data = &s[0];
+    }
+
+    Mutex::Autolock _l(mLock);
+    mJobs.push_back(job);
+    mBacklogMax = max(mBacklogMax, (unsigned int)mJobs.size());
+    mCondition.broadcast();
+}
+
+bool FrameVerifier::threadLoop()
+{
+    Job job;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mJobs.empty() && !mStopping)
+            mCondition.wait(mLock);
+        if (mJobs.empty())
+            return false;
+        job = mJobs.front();    // Stays queued, and counted as backlog, until done
+    }
+
+    uint32_t crc = crc32c(0, job.data, job.len);
+    LOGD("\"%s\" frame %llu crc %08x queued %lld", mName.c_str(),
+            (unsigned long long)job.index, crc, (long long)job.queued);
+
+    // A frame shown again while recording has to match its first showing
+    bool mismatch = false;
+    map<uint64_t, uint32_t>::iterator it = mManifest.find(job.index);
+    if (it != mManifest.end()) {
+        mismatch = it->second != crc;
+        if (mismatch)
+            LOGW("\"%s\" frame %llu crc %08x, expected %08x", mName.c_str(),
+                    (unsigned long long)job.index, crc, it->second);
+    } else if (mRecording) {
+        mManifest[job.index] = crc;
+    }
+
+    Mutex::Autolock _l(mLock);
+    mJobs.erase(mJobs.begin());
+    if (job.snapshot >= 0)
+        mFree.push_back(job.snapshot);
+    mHashed++;
+    if (mismatch)
+        mMismatches++;
+    mCondition.broadcast();
+    return true;
+}
+
+void FrameVerifier::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mJobs.empty())
+            mCondition.wait(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    requestExitAndWait();
+
+    if (mRecording && writeManifest())
+        mRecording = false;
+}
+
+bool FrameVerifier::writeManifest()
+{
+    string tmp = mManifestPath + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (f == NULL) {
+        LOGE("\"%s\" unable to write manifest '%s': %s", mName.c_str(), tmp.c_str(),
+                strerror(errno));
+        return false;
+    }
+
+    fprintf(f, "# \"%s\" frame crc32c\n", mName.c_str());
+    for (map<uint64_t, uint32_t>::iterator it = mManifest.begin(); it != mManifest.end(); it++)
+        fprintf(f, "%llu %08x\n", (unsigned long long)it->first, it->second);
+
+    bool ok = fclose(f) == 0 && rename(tmp.c_str(), mManifestPath.c_str()) == 0;
+    if (!ok) {
+        LOGE("\"%s\" unable to write manifest '%s': %s", mName.c_str(),
+                mManifestPath.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    LOGD("\"%s\" recorded %u frames to '%s'", mName.c_str(), (unsigned int)mManifest.size(),
+            mManifestPath.c_str());
+    return true;
+}
+
+void FrameVerifier::collect(Stat& stat)
+{
+    Mutex::Autolock _l(mLock);
+    stat.addVerified(mHashed, mBacklogMax, mDropped, mMismatches);
+    mHashed = mDropped = mMismatches = 0;
+    mBacklogMax = mJobs.size();
+}
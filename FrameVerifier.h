@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FRAME_VERIFIER_H
+#define _FRAME_VERIFIER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "Stat.h"
+
+using namespace android;
+
+// Checksums (CRC32C) the frames a surface queues on a thread of its own, so
+// that stale or wrong frames show up without slowing the update loop. Frames
+// that may change once submit() returns are copied into a small pool of
+// snapshots; when the pool is full the frame is dropped from verification
+// rather than making the producer wait.
+//
+// Given a manifest of "<index> <crc>" lines, checksums are compared against
+// it. A manifest that doesn't exist yet is recorded from this run instead.
+class FrameVerifier : public Thread {
+    public:
+        FrameVerifier(std::string name, unsigned int snapshots);
+        virtual ~FrameVerifier();
+
+        bool setManifest(std::string path);
+
+        // index identifies the frame within the content, e.g. the clip
+        // frame. stable data stays valid and unchanged for the whole run.
+        void submit(uint64_t index, const void *data, size_t len, bool stable);
+
+        // Waits for the backlog, then writes a manifest being recorded
+        void stop();
+
+        // Hands counts since the last collect to stat
+        void collect(Stat& stat);
+
+        static uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+    private:
+        struct Job {
+            uint64_t index;
+            const uint8_t *data;
+            size_t len;
+            nsecs_t queued;
+            int snapshot;   // -1 for stable data
+        };
+
+        virtual bool threadLoop();
+        bool writeManifest();
+
+        std::string mName;
+        std::string mManifestPath;
+        bool mRecording;
+        std::map<uint64_t, uint32_t> mManifest;
+
+        Mutex mLock;
+        Condition mCondition;
+        std::vector<Job> mJobs;
+        std::vector<std::vector<uint8_t> > mSnapshots;
+        std::vector<int> mFree;
+        unsigned int mMaxPending;
+        bool mStopping;
+
+        // Counts since the last collect
+        unsigned int mHashed;
+        unsigned int mDropped;
+        unsigned int mMismatches;
+        unsigned int mBacklogMax;
+};
+
+#endif
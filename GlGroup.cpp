@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <algorithm>
+
+#include "GlGroup.h"
+#include "LocalTypes.h"
+
+using namespace android;
+using namespace std;
+
+GlGroup::GlGroup(const string& name) : Thread(false), mName(name), mRetired(0),
+    mStarted(false), mGate(NULL), mBarrier(false), mWoken(false), mDisplay(EGL_NO_DISPLAY)
+{
+}
+
+const string& GlGroup::name()
+{
+    return mName;
+}
+
+void GlGroup::assign(sp<TestBase> member, bool initial)
+{
+    Member m;
+    m.thread = member;
+    m.initial = initial;
+    m.added = false;
+    m.state = WAITING;
+    mMembers.push_back(m);
+    member->setGlGroup(this);
+}
+
+bool GlGroup::hasInitial()
+{
+    for (size_t i = 0; i < mMembers.size(); i++) {
+        if (mMembers[i].initial)
+            return true;
+    }
+    return false;
+}
+
+void GlGroup::setStartupGate(StartupGate *gate, bool barrier)
+{
+    mGate = gate;
+    mBarrier = barrier;
+}
+
+// Running it again would bring the initial members up a second time and
+// arrive at the startup barrier twice
+status_t GlGroup::start()
+{
+    if (mStarted)
+        return isRunning() ? NO_ERROR : INVALID_OPERATION;
+    mStarted = true;
+    return run();
+}
+
+bool GlGroup::hasStarted()
+{
+    return mStarted;
+}
+
+void GlGroup::add(sp<TestBase> member)
+{
+    Mutex::Autolock _l(mLock);
+
+    for (size_t i = 0; i < mMembers.size(); i++) {
+        if (mMembers[i].thread == member) {
+            mMembers[i].added = true;
+            member->enterGroup();
+        }
+    }
+    mWoken = true;
+    mCondition.signal();
+}
+
+void GlGroup::abandon()
+{
+    for (size_t i = 0; i < mMembers.size(); i++) {
+        if (mMembers[i].state != RETIRED)
+            retire(mMembers[i]);
+    }
+}
+
+bool GlGroup::added(Member& m)
+{
+    Mutex::Autolock _l(mLock);
+    return m.added;
+}
+
+// The first context of a version is the root of its share group, later
+// configs share with it so that all members see the same objects
+EGLContext GlGroup::context(EGLDisplay display, EGLConfig config, int version)
+{
+    pair<EGLConfig, int> key(config, version);
+    map<pair<EGLConfig, int>, EGLContext>::iterator it = mContexts.find(key);
+    if (it != mContexts.end())
+        return it->second;
+
+    EGLContext root = mRoots.count(version) > 0 ? mRoots[version] : EGL_NO_CONTEXT;
+    const EGLint attribs[] = { EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE };
+    EGLContext context = eglCreateContext(display, config, root, attribs);
+    if (context == EGL_NO_CONTEXT) {
+        LOGE("group \"%s\" failed to create context, error 0x%x", mName.c_str(), eglGetError());
+        return 0;
+    }
+
+    if (root == EGL_NO_CONTEXT)
+        mRoots[version] = context;
+    mDisplay = display;
+    mContexts[key] = context;
+    LOGD("group \"%s\" has %d contexts", mName.c_str(), (int)mContexts.size());
+    return context;
+}
+
+// All members run on this thread, so only one can place it. The others
+// get a warning when they asked for something else.
+bool GlGroup::claimScheduling(const sp<SurfaceSpec>& spec)
+{
+    if (mSchedOwner.empty()) {
+        mSchedOwner = spec->name;
+        mSched = spec->sched;
+        return true;
+    }
+
+    const SchedParams& s = spec->sched;
+    if (s.cpuMask != mSched.cpuMask || s.policy != mSched.policy ||
+            s.priority != mSched.priority || s.nice != mSched.nice ||
+            s.uclampMin != mSched.uclampMin || s.uclampMax != mSched.uclampMax ||
+            s.cgroup != mSched.cgroup)
+        LOGW("\"%s\" scheduling differs from \"%s\" in group \"%s\", the group thread "
+                "keeps the latter's", spec->name.c_str(), mSchedOwner.c_str(), mName.c_str());
+    return false;
+}
+
+// Bring-up as the member's own thread would do it, gate slot included
+bool GlGroup::prepare(Member& m)
+{
+    if (m.thread->readyToRun() != NO_ERROR || m.thread->done()) {
+        retire(m);
+        return false;
+    }
+    m.state = PREPARED;
+    return true;
+}
+
+void GlGroup::retire(Member& m)
+{
+    if (m.state == ACTIVE)
+        m.thread->endUpdates();
+    else
+        m.thread->loopDone();
+    m.state = RETIRED;
+    mRetired++;
+}
+
+// The surfaces starting with the run arrive at the barrier together, as if
+// they were one
+status_t GlGroup::readyToRun()
+{
+    StartupTimes sum;
+    bool ok = false;
+
+    for (size_t i = 0; i < mMembers.size(); i++) {
+        Member& m = mMembers[i];
+        if (!m.initial || m.thread->done())
+            continue;
+        if (!prepare(m))
+            continue;
+
+        const StartupTimes& t = m.thread->startupTimes();
+        sum.slot += t.slot;
+        sum.surface += t.surface;
+        sum.egl += t.egl;
+        sum.content += t.content;
+        sum.setup += t.setup;
+        ok = true;
+    }
+
+    if (mGate != NULL && mBarrier) {
+        mGate->arrive(mName.c_str(), ok, sum);
+        for (size_t i = 0; i < mMembers.size(); i++) {
+            if (mMembers[i].state == PREPARED)
+                mMembers[i].thread->resetStart();
+        }
+    }
+
+    LOGD("group \"%s\" running %d surfaces", mName.c_str(), (int)mMembers.size());
+    return NO_ERROR;
+}
+
+bool GlGroup::threadLoop()
+{
+    for (size_t i = 0; i < mMembers.size(); i++) {
+        Member& m = mMembers[i];
+        if (m.state == RETIRED || m.state == ACTIVE)
+            continue;
+
+        // Stopped before its start came
+        if (m.thread->done()) {
+            retire(m);
+            continue;
+        }
+        if (!added(m))
+            continue;
+        if (m.state == WAITING && !prepare(m))
+            continue;
+
+        m.thread->beginUpdates();
+        m.state = ACTIVE;
+    }
+
+    nsecs_t now = systemTime();
+    nsecs_t next = now + ms2ns(IDLE_MS);
+    for (size_t i = 0; i < mMembers.size(); i++) {
+        Member& m = mMembers[i];
+        if (m.state != ACTIVE)
+            continue;
+        if (m.thread->done()) {
+            retire(m);
+            continue;
+        }
+
+        nsecs_t due = m.thread->nextDue();
+        if (due <= now) {
+            if (!m.thread->iterate()) {
+                retire(m);
+                continue;
+            }
+            now = systemTime();
+            due = m.thread->nextDue();
+        }
+        next = min(next, due);
+    }
+
+    if (mRetired == mMembers.size()) {
+        if (mDisplay != EGL_NO_DISPLAY) {
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            for (map<pair<EGLConfig, int>, EGLContext>::iterator it = mContexts.begin();
+                    it != mContexts.end(); ++it)
+                eglDestroyContext(mDisplay, it->second);
+        }
+        mContexts.clear();
+        mRoots.clear();
+        LOGD("group \"%s\" exiting", mName.c_str());
+        return false;
+    }
+
+    Mutex::Autolock _l(mLock);
+    now = systemTime();
+    if (!mWoken && next > now)
+        mCondition.waitRelative(mLock, next - now);
+    mWoken = false;
+    return true;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GL_GROUP_H
+#define _GL_GROUP_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "TestBase.h"
+
+using namespace android;
+
+// GL surfaces rendered by one thread on one context, rather than a thread
+// and a context each. Every pass the group makes the surfaces that are due
+// current in turn and runs one iteration of theirs, so what's measured is
+// the cost of many surfaces sharing a GPU context: the switches (mc:) and
+// each surface's draw up to its swap (dr:). Surfaces whose config differs
+// from the first get a context in its share group, per GLES version. The
+// GL state is shared as well, content that sets state once has to agree
+// with its neighbours.
+//
+// The group brings up the surfaces starting with the run as one party of
+// the startup barrier, later ones when their start comes.
+class GlGroup : public Thread {
+    public:
+        GlGroup(const std::string& name);
+
+        const std::string& name();
+
+        // Before the group runs, initial for a surface starting with the run
+        void assign(sp<TestBase> member, bool initial);
+        bool hasInitial();
+        void setStartupGate(StartupGate *gate, bool barrier);
+
+        // Runs the group thread, once: a group that has finished stays so
+        status_t start();
+        bool hasStarted();
+
+        // A member's start, from the manager
+        void add(sp<TestBase> member);
+        // Ends the members of a group that couldn't run
+        void abandon();
+
+        // For members' initEgl, on the group's thread
+        EGLContext context(EGLDisplay display, EGLConfig config, int version);
+
+        // For members' prepare, on the group's thread: true for the member
+        // whose scheduling the thread takes, the first one
+        bool claimScheduling(const sp<SurfaceSpec>& spec);
+
+    private:
+        enum { IDLE_MS = 10 };  // Longest sleep, so stops are noticed
+
+        enum State { WAITING, PREPARED, ACTIVE, RETIRED };
+
+        struct Member {
+            sp<TestBase> thread;
+            bool initial;
+            bool added;
+            State state;
+        };
+
+        bool prepare(Member& m);
+        void retire(Member& m);
+        bool added(Member& m);
+        status_t readyToRun();
+        bool threadLoop();
+
+        std::string mName;
+        std::vector<Member> mMembers;   // Fixed once running
+        size_t mRetired;
+        bool mStarted;
+
+        StartupGate *mGate;
+        bool mBarrier;
+
+        Mutex mLock;
+        Condition mCondition;
+        bool mWoken;
+
+        // Contexts of different GLES versions can't share, each version has
+        // a share group of its own
+        EGLDisplay mDisplay;
+        std::map<int, EGLContext> mRoots;
+        std::map<std::pair<EGLConfig, int>, EGLContext> mContexts;
+
+        std::string mSchedOwner;
+        SchedParams mSched;
+};
+
+#endif
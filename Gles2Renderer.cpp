@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include "Gles2Renderer.h"
+
+using namespace android;
+using namespace std;
+
+static const char sVertexShader[] =
+    "attribute vec4 aPosition;\n"
+    "attribute vec2 aTexCoord;\n"
+    "varying vec2 vTexCoord;\n"
+    "void main() {\n"
+    "    gl_Position = aPosition;\n"
+    "    vTexCoord = aTexCoord;\n"
+    "}\n";
+
+// BT.601 limited range, U and V interleaved as luminance and alpha
+static const char sNV12Shader[] =
+    "precision mediump float;\n"
+    "varying vec2 vTexCoord;\n"
+    "uniform sampler2D uPlane0;\n"
+    "uniform sampler2D uPlane1;\n"
+    "void main() {\n"
+    "    float y = 1.1644 * (texture2D(uPlane0, vTexCoord).r - 0.0625);\n"
+    "    vec2 uv = texture2D(uPlane1, vTexCoord).ra - 0.5;\n"
+    "    gl_FragColor = vec4(y + 1.5960 * uv.y,\n"
+    "            y - 0.3918 * uv.x - 0.8130 * uv.y,\n"
+    "            y + 2.0172 * uv.x, 1.0);\n"
+    "}\n";
+
+static const char sRGBShader[] =
+    "precision mediump float;\n"
+    "varying vec2 vTexCoord;\n"
+    "uniform sampler2D uPlane0;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(uPlane0, vTexCoord);\n"
+    "}\n";
+
+// Uploaded as RGBA, so red and blue are swapped back while sampling
+static const char sBGRShader[] =
+    "precision mediump float;\n"
+    "varying vec2 vTexCoord;\n"
+    "uniform sampler2D uPlane0;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(uPlane0, vTexCoord).bgra;\n"
+    "}\n";
+
+static const char sBGRXShader[] =
+    "precision mediump float;\n"
+    "varying vec2 vTexCoord;\n"
+    "uniform sampler2D uPlane0;\n"
+    "void main() {\n"
+    "    gl_FragColor = vec4(texture2D(uPlane0, vTexCoord).bgr, 1.0);\n"
+    "}\n";
+
+// The whole viewport as a strip: bottom left, bottom right, top left, top right
+static const GLfloat sPositions[] = { -1, -1,  1, -1,  -1, 1,  1, 1 };
+
+Gles2Renderer::Gles2Renderer(const sp<SurfaceSpec>& spec) : mSpec(spec),
+    mNV12(spec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12), mProgram(0), mPosition(-1),
+    mTexCoord(-1), mPlane0(-1), mPlane1(-1)
+{
+}
+
+Gles2Renderer::~Gles2Renderer()
+{
+    if (!mTextures.empty())
+        glDeleteTextures(mTextures.size(), &mTextures[0]);
+    if (mProgram != 0)
+        glDeleteProgram(mProgram);
+}
+
+GLuint Gles2Renderer::compile(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    if (shader == 0)
+        return 0;
+
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        LOGE("\"%s\" shader compile failed: %s", mSpec->name.c_str(), log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+bool Gles2Renderer::init()
+{
+    const char *fragment;
+    switch (mSpec->bufferFormat) {
+        case HAL_PIXEL_FORMAT_TI_NV12:
+            fragment = sNV12Shader;
+            break;
+        case PIXEL_FORMAT_BGRA_8888:
+            fragment = sBGRShader;
+            break;
+        case HAL_PIXEL_FORMAT_TI_BGRX:
+            fragment = sBGRXShader;
+            break;
+        case PIXEL_FORMAT_RGBA_8888:
+        case PIXEL_FORMAT_RGBX_8888:
+        case PIXEL_FORMAT_RGB_565:
+            fragment = sRGBShader;
+            break;
+        default:
+            LOGE("\"%s\" unsupported texture format", mSpec->name.c_str());
+            return false;
+    }
+
+    GLuint vs = compile(GL_VERTEX_SHADER, sVertexShader);
+    GLuint fs = compile(GL_FRAGMENT_SHADER, fragment);
+    if (vs == 0 || fs == 0) {
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        return false;
+    }
+
+    mProgram = glCreateProgram();
+    glAttachShader(mProgram, vs);
+    glAttachShader(mProgram, fs);
+    glLinkProgram(mProgram);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok = GL_FALSE;
+    glGetProgramiv(mProgram, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[512];
+        glGetProgramInfoLog(mProgram, sizeof(log), NULL, log);
+        LOGE("\"%s\" program link failed: %s", mSpec->name.c_str(), log);
+        return false;
+    }
+
+    mPosition = glGetAttribLocation(mProgram, "aPosition");
+    mTexCoord = glGetAttribLocation(mProgram, "aTexCoord");
+    mPlane0 = glGetUniformLocation(mProgram, "uPlane0");
+    mPlane1 = glGetUniformLocation(mProgram, "uPlane1");
+
+    // Rows of the clip are tightly packed at its stride
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glDisable(GL_DITHER);
+    glDisable(GL_BLEND);
+
+    setTexCoords();
+    return true;
+}
+
+// Texture coordinates of the quad's corners. The texture is stride texels
+// wide and the clip's first row is at t = 0. The transform is the one
+// the window would apply, flips first and then a clockwise quarter turn, so
+// each corner undoes it to find its source.
+void Gles2Renderer::setTexCoords()
+{
+    const SrcGeometry& g = mSpec->srcGeometry;
+    Rect crop = g.crop.isValid() ? g.crop : Rect(0, 0, g.width, g.height);
+    const float s0 = (float)crop.left / g.stride, s1 = (float)crop.right / g.stride;
+    const float t0 = (float)crop.top / g.height, t1 = (float)crop.bottom / g.height;
+    const int transform = mSpec->transform;
+
+    for (int i = 0; i < 4; i++) {
+        // Corner on screen, 0..1 with y down
+        float x = sPositions[i * 2] > 0 ? 1 : 0;
+        float y = sPositions[i * 2 + 1] > 0 ? 0 : 1;
+
+        if (transform & HAL_TRANSFORM_ROT_90) {
+            float sx = x;
+            x = y;
+            y = 1 - sx;
+        }
+        if (transform & HAL_TRANSFORM_FLIP_V)
+            y = 1 - y;
+        if (transform & HAL_TRANSFORM_FLIP_H)
+            x = 1 - x;
+
+        mTexCoords[i * 2] = s0 + x * (s1 - s0);
+        mTexCoords[i * 2 + 1] = t0 + y * (t1 - t0);
+    }
+}
+
+GLuint Gles2Renderer::createTexture(GLsizei width, GLsizei height, GLenum format, GLenum type,
+        const void *data)
+{
+    GLuint tid;
+    glGenTextures(1, &tid);
+    glBindTexture(GL_TEXTURE_2D, tid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, type, data);
+    mTextures.push_back(tid);
+    return tid;
+}
+
+// Not power of two sized, which GLES 2 allows with clamping and no mipmaps
+bool Gles2Renderer::addFrame(const void *data)
+{
+    const SrcGeometry& g = mSpec->srcGeometry;
+    const char *p = (const char*)data;
+
+    switch (mSpec->bufferFormat) {
+        case HAL_PIXEL_FORMAT_TI_NV12:
+            createTexture(g.stride, g.height, GL_LUMINANCE, GL_UNSIGNED_BYTE, p);
+            createTexture(g.stride / 2, g.height / 2, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+                    p + g.stride * g.height);
+            break;
+        case PIXEL_FORMAT_RGB_565:
+            createTexture(g.stride, g.height, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, p);
+            break;
+        default:
+            createTexture(g.stride, g.height, GL_RGBA, GL_UNSIGNED_BYTE, p);
+            break;
+    }
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        LOGE("\"%s\" texture upload failed, error 0x%x", mSpec->name.c_str(), error);
+        return false;
+    }
+    return true;
+}
+
+void Gles2Renderer::draw(size_t frame, int width, int height)
+{
+    glViewport(0, 0, width, height);
+    glUseProgram(mProgram);
+
+    const size_t planes = mNV12 ? 2 : 1;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mTextures.at(frame * planes));
+    glUniform1i(mPlane0, 0);
+    if (mNV12) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, mTextures.at(frame * planes + 1));
+        glUniform1i(mPlane1, 1);
+    }
+
+    glVertexAttribPointer(mPosition, 2, GL_FLOAT, GL_FALSE, 0, sPositions);
+    glEnableVertexAttribArray(mPosition);
+    glVertexAttribPointer(mTexCoord, 2, GL_FLOAT, GL_FALSE, 0, mTexCoords);
+    glEnableVertexAttribArray(mTexCoord);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+uint64_t Gles2Renderer::frameBytes()
+{
+    const SrcGeometry& g = mSpec->srcGeometry;
+    Rect crop = g.crop.isValid() ? g.crop : Rect(0, 0, g.width, g.height);
+    uint64_t pixels = (uint64_t)crop.width() * crop.height();
+    if (mNV12)
+        return pixels * 3 / 2;
+    return pixels * (mSpec->bufferFormat == PIXEL_FORMAT_RGB_565 ? 2 : 4);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GLES2_RENDERER_H
+#define _GLES2_RENDERER_H
+
+#include <vector>
+
+#include <GLES2/gl2.h>
+
+#include "LocalTypes.h"
+
+using namespace android;
+
+// FILE content drawn with GLES 2, one textured quad per update. NV12 frames
+// are uploaded as a Y and a UV plane and converted to RGB by the fragment
+// shader, the RGB formats are sampled as they are. The quad's texture
+// coordinates apply the spec's crop and transform, so the GPU does the work
+// the composer would otherwise do. Needs the surface's GLES 2 context
+// current for everything but the constructor.
+class Gles2Renderer {
+    public:
+        Gles2Renderer(const sp<SurfaceSpec>& spec);
+        ~Gles2Renderer();
+
+        bool init();
+
+        // Uploads one frame of the clip, frames are drawn by index in the
+        // order they were added
+        bool addFrame(const void *data);
+        void draw(size_t frame, int width, int height);
+
+        // Texture bytes sampled per draw
+        uint64_t frameBytes();
+
+    private:
+        GLuint compile(GLenum type, const char *source);
+        GLuint createTexture(GLsizei width, GLsizei height, GLenum format, GLenum type,
+                const void *data);
+        void setTexCoords();
+
+        sp<SurfaceSpec> mSpec;
+        bool mNV12;
+        GLuint mProgram;
+        GLint mPosition;
+        GLint mTexCoord;
+        GLint mPlane0;
+        GLint mPlane1;
+        GLfloat mTexCoords[8];
+        std::vector<GLuint> mTextures; // Two per frame for NV12, Y then UV
+};
+
+#endif
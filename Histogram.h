@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// Power of two histogram for durations in usecs. Bucket 0 holds values below
+// 1us, bucket i holds [2^(i-1), 2^i) and the last bucket everything above.
+class Histogram {
+    public:
+        enum { BUCKETS = 24 };
+
+        Histogram()
+        {
+            clear();
+        }
+
+        void clear()
+        {
+            for (int i = 0; i < BUCKETS; i++)
+                mBuckets[i] = 0;
+            mCount = 0;
+            mSum = 0;
+            mMin = LLONG_MAX;
+            mMax = 0;
+        }
+
+        void add(int64_t v)
+        {
+            if (v < 0)
+                v = 0;
+
+            int i = 0;
+            while (i < BUCKETS - 1 && v >= ((int64_t)1 << i))
+                i++;
+            mBuckets[i]++;
+
+            mCount++;
+            mSum += v;
+            if (v < mMin)
+                mMin = v;
+            if (v > mMax)
+                mMax = v;
+        }
+
+        uint64_t count() const
+        {
+            return mCount;
+        }
+
+        int64_t min() const
+        {
+            return mCount > 0 ? mMin : 0;
+        }
+
+        int64_t max() const
+        {
+            return mMax;
+        }
+
+        int64_t avg() const
+        {
+            return mCount > 0 ? mSum / (int64_t)mCount : 0;
+        }
+
+        // Upper bound of the bucket holding the p:th percentile (0-100)
+        int64_t percentile(double p) const
+        {
+            if (mCount == 0)
+                return 0;
+
+            uint64_t target = (uint64_t)(mCount * p / 100.0 + 0.5);
+            if (target == 0)
+                target = 1;
+
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                seen += mBuckets[i];
+                if (seen >= target)
+                    return i < BUCKETS - 1 ? ((int64_t)1 << i) : mMax;
+            }
+            return mMax;
+        }
+
+        // "<upper bound>:<count>" for each non-empty bucket, space separated
+        std::string toString() const
+        {
+            std::string s;
+            char buf[48];
+
+            for (int i = 0; i < BUCKETS; i++) {
+                if (mBuckets[i] == 0)
+                    continue;
+                if (i < BUCKETS - 1)
+                    snprintf(buf, sizeof(buf), "%s<%lld:%llu", s.empty() ? "" : " ",
+                            (long long)1 << i, (unsigned long long)mBuckets[i]);
+                else
+                    snprintf(buf, sizeof(buf), "%s>=%lld:%llu", s.empty() ? "" : " ",
+                            (long long)1 << (i - 1), (unsigned long long)mBuckets[i]);
+                s += buf;
+            }
+            return s;
+        }
+
+        // Summary, percentiles and the non-empty buckets as a JSON object.
+        // Buckets are [upper bound, count], the last one's bound is -1.
+        std::string toJson() const
+        {
+            char buf[160];
+            snprintf(buf, sizeof(buf), "{\"count\": %llu, \"min\": %lld, \"avg\": %lld, "
+                    "\"max\": %lld, \"p50\": %lld, \"p90\": %lld, \"p99\": %lld, ",
+                    (unsigned long long)mCount, (long long)min(), (long long)avg(),
+                    (long long)max(), (long long)percentile(50), (long long)percentile(90),
+                    (long long)percentile(99));
+            std::string s = buf;
+
+            s += "\"buckets\": [";
+            bool first = true;
+            for (int i = 0; i < BUCKETS; i++) {
+                if (mBuckets[i] == 0)
+                    continue;
+                snprintf(buf, sizeof(buf), "%s[%lld, %llu]", first ? "" : ", ",
+                        i < BUCKETS - 1 ? (long long)1 << i : -1LL,
+                        (unsigned long long)mBuckets[i]);
+                s += buf;
+                first = false;
+            }
+            s += "]}";
+            return s;
+        }
+
+    private:
+        uint64_t mBuckets[BUCKETS];
+        uint64_t mCount;
+        int64_t mSum;
+        int64_t mMin;
+        int64_t mMax;
+};
+
+#endif
@@ -69,6 +69,17 @@ namespace RenderFlags {
         ASYNC           = 1 << 2,
         SILENT          = 1 << 3,
         VSYNC           = 1 << 4,
+        PERF            = 1 << 5,
+        GLES2           = 1 << 6,
+    };
+};
+
+// How FILE content is brought into memory before the first update
+namespace Prefault {
+    enum Enum {
+        POPULATE        = 1 << 0,   // Read and map every page up front
+        MLOCK           = 1 << 1,   // Keep the pages resident
+        HUGEPAGE        = 1 << 2,   // Copy to anonymous memory backed by THP
     };
 };
 
@@ -82,6 +93,7 @@ class UpdateParams {
     public:
         long iterations;
         unsigned int latency;
+        unsigned int latencyPhase;
         DutyCycle contentUpdateCycle;
         DutyCycle showCycle;
         DutyCycle positionCycle;
@@ -90,6 +102,92 @@ class UpdateParams {
         android::Rect outRectLimit;
 };
 
+// Changes applied to a running surface at a point of the run timeline
+class Phase {
+    public:
+        enum Field {
+            LATENCY     = 1 << 0,
+            CONTENT     = 1 << 1,
+            SHOW        = 1 << 2,
+            POSITION    = 1 << 3,
+            SIZE        = 1 << 4,
+        };
+
+        unsigned int time;      // ms after the run started
+        unsigned int fields;    // Field bits given by the phase
+        unsigned int latency;
+        DutyCycle contentUpdateCycle;
+        DutyCycle showCycle;
+        DutyCycle positionCycle;
+        DutyCycle sizeCycle;
+
+        Phase() : time(0), fields(0), latency(0) {
+            contentUpdateCycle.onCount = showCycle.onCount = 1;
+            positionCycle.onCount = sizeCycle.onCount = 1;
+            contentUpdateCycle.offCount = showCycle.offCount = 0;
+            positionCycle.offCount = sizeCycle.offCount = 0;
+        }
+
+        // Take over the fields given by o
+        void merge(const Phase& o) {
+            if (o.fields & LATENCY)
+                latency = o.latency;
+            if (o.fields & CONTENT)
+                contentUpdateCycle = o.contentUpdateCycle;
+            if (o.fields & SHOW)
+                showCycle = o.showCycle;
+            if (o.fields & POSITION)
+                positionCycle = o.positionCycle;
+            if (o.fields & SIZE)
+                sizeCycle = o.sizeCycle;
+            fields |= o.fields;
+        }
+
+        void applyCycles(UpdateParams& p) const {
+            if (fields & CONTENT)
+                p.contentUpdateCycle = contentUpdateCycle;
+            if (fields & SHOW)
+                p.showCycle = showCycle;
+            if (fields & POSITION)
+                p.positionCycle = positionCycle;
+            if (fields & SIZE)
+                p.sizeCycle = sizeCycle;
+        }
+};
+
+// One point of an animation track. Values between keyframes are
+// interpolated by time.
+class Keyframe {
+    public:
+        enum Track { POSITION, SIZE, ALPHA, TRACK_MAX };
+        enum Easing { LINEAR, EASE };
+
+        Track track;
+        unsigned int time;  // ms after the surface started
+        int a;              // x, w or alpha (0-255)
+        int b;              // y or h
+        Easing easing;      // From the previous keyframe to this one
+};
+
+// Placement and scheduling of a surface thread, applied by the thread itself
+// before its first update. Fields left at their defaults keep what the
+// thread inherited from the process.
+class SchedParams {
+    public:
+        enum { NICE_KEEP = 100 };
+
+        uint64_t cpuMask;       // Allowed CPUs, bit n for CPU n, 0 for any
+        int policy;             // SCHED_OTHER, SCHED_FIFO, ..., -1 to keep
+        int priority;           // Real-time priority for SCHED_FIFO and SCHED_RR
+        int nice;               // -20 to 19
+        int uclampMin;          // Utilization clamp 0 to 1024, -1 to keep
+        int uclampMax;
+        std::string cgroup;     // Directory the thread is added to, e.g. a cpuset
+
+        SchedParams() : cpuMask(0), policy(-1), priority(0), nice(NICE_KEEP),
+            uclampMin(-1), uclampMax(-1) {}
+};
+
 class SrcGeometry {
     public:
         int width;
@@ -113,6 +211,21 @@ class SurfaceSpec : public android::RefBase {
         std::string content;
         UpdateParams updateParams;
         uint32_t flags;
+        unsigned int bufferCount;   // 0 keeps the window default
+        unsigned int pipelineDepth; // Buffers filled ahead, 0 to fill in place
+        int prefault;
+        unsigned int readAhead;     // Frames loaded ahead of FILE content, 0 maps the file
+        bool verify;                // Checksum frames on a background thread
+        std::string verifyManifest; // Expected checksums, recorded if missing
+        std::string capture;        // File produced frames are written to
+        unsigned int captureFrames; // Frames buffered for the capture writer
+        SchedParams sched;
+        std::string glGroup;        // Surfaces of a group render on one thread and context
+        unsigned int startDelay;    // ms after the run started
+        unsigned int stopTime;      // ms after the run started, 0 for no limit
+        android::List<Phase> phases;
+        android::List<Keyframe> keyframes;
+        bool keyframeLoop;
 
         SurfaceSpec() {
             // Set somewhat reasonable initial values in case user forgot
@@ -131,6 +244,7 @@ class SurfaceSpec : public android::RefBase {
             content = "FF0000FF";
             updateParams.iterations = 5;
             updateParams.latency = 1000000;
+            updateParams.latencyPhase = 0;
             updateParams.contentUpdateCycle.onCount = 1;
             updateParams.contentUpdateCycle.offCount = 0;
             updateParams.showCycle.onCount = 1;
@@ -142,11 +256,55 @@ class SurfaceSpec : public android::RefBase {
             updateParams.outRectStep.clear();
             updateParams.outRectLimit.clear();
             flags = 0;
+            bufferCount = 0;
+            pipelineDepth = 0;
+            prefault = 0;
+            readAhead = 0;
+            verify = false;
+            captureFrames = 8;
+            startDelay = 0;
+            stopTime = 0;
+            keyframeLoop = false;
         }
 
         bool renderFlag(RenderFlags::Enum f) {
             return (renderFlags & f) != 0;
         };
+
+        // RefBase can't be copied, so copy field by field. New fields also
+        // need to go to SpecCache, with its version bumped.
+        android::sp<SurfaceSpec> clone() {
+            android::sp<SurfaceSpec> s = new SurfaceSpec();
+            s->name = name;
+            s->renderFlags = renderFlags;
+            s->format = format;
+            s->bufferFormat = bufferFormat;
+            s->zOrder = zOrder;
+            s->transform = transform;
+            s->srcGeometry = srcGeometry;
+            s->outRect = outRect;
+            s->transparentRegionHint = transparentRegionHint;
+            s->contentType = contentType;
+            s->content = content;
+            s->updateParams = updateParams;
+            s->flags = flags;
+            s->bufferCount = bufferCount;
+            s->pipelineDepth = pipelineDepth;
+            s->prefault = prefault;
+            s->readAhead = readAhead;
+            s->verify = verify;
+            s->verifyManifest = verifyManifest;
+            s->capture = capture;
+            s->captureFrames = captureFrames;
+            s->sched = sched;
+            s->glGroup = glGroup;
+            s->startDelay = startDelay;
+            s->stopTime = stopTime;
+            s->phases = phases;
+            s->keyframes = keyframes;
+            s->keyframeLoop = keyframeLoop;
+            return s;
+        }
     private:
         SurfaceSpec& operator = (SurfaceSpec& li);
 };
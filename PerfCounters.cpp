@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "LocalTypes.h"
+#include "PerfCounters.h"
+
+struct CounterDesc {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+};
+
+static const CounterDesc sCounters[PerfCounters::COUNTER_MAX] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "llc misses" },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "dtlb misses" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page faults" },
+};
+
+static int openCounter(const CounterDesc& d, int group, bool excludeKernel)
+{
+#ifdef __NR_perf_event_open
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = d.type;
+    attr.config = d.config;
+    attr.disabled = group < 0 ? 1 : 0; // Members follow the leader
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // Calling thread, any cpu
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+PerfCounters::PerfCounters() : mLeader(-1), mMembers(0)
+{
+    for (int i = 0; i < COUNTER_MAX; i++) {
+        mFds[i] = -1;
+        mOrder[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+bool PerfCounters::open()
+{
+    close();
+
+    // Kernel time is interesting (page fault handling, cache maintenance in
+    // lock/unlock), but most devices restrict it with perf_event_paranoid.
+    bool excludeKernel = false;
+
+    for (int i = 0; i < COUNTER_MAX; i++) {
+        int fd = openCounter(sCounters[i], mLeader, excludeKernel);
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && !excludeKernel) {
+            excludeKernel = true;
+            fd = openCounter(sCounters[i], mLeader, excludeKernel);
+        }
+
+        if (fd < 0) {
+            LOGD("perf counter '%s' unavailable: %s", sCounters[i].name, strerror(errno));
+            continue;
+        }
+
+        if (mLeader < 0)
+            mLeader = fd;
+        mFds[i] = fd;
+        mOrder[mMembers++] = i;
+    }
+
+    if (mLeader < 0)
+        return false;
+
+    LOGD("opened %d perf counters%s", mMembers, excludeKernel ? " (user only)" : "");
+    return true;
+}
+
+void PerfCounters::close()
+{
+    // Members before leader
+    for (int i = COUNTER_MAX - 1; i >= 0; i--) {
+        if (mFds[i] >= 0 && mFds[i] != mLeader)
+            ::close(mFds[i]);
+        mFds[i] = -1;
+        mOrder[i] = -1;
+    }
+
+    if (mLeader >= 0)
+        ::close(mLeader);
+    mLeader = -1;
+    mMembers = 0;
+}
+
+bool PerfCounters::isOpen()
+{
+    return mLeader >= 0;
+}
+
+bool PerfCounters::available(Counter c)
+{
+    return mFds[c] >= 0;
+}
+
+void PerfCounters::start()
+{
+    if (mLeader < 0)
+        return;
+
+    ioctl(mLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(mLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+bool PerfCounters::stop(uint64_t values[COUNTER_MAX])
+{
+    // nr, time enabled, time running, one value per member
+    uint64_t buf[3 + COUNTER_MAX];
+
+    for (int i = 0; i < COUNTER_MAX; i++)
+        values[i] = 0;
+
+    if (mLeader < 0)
+        return false;
+
+    ioctl(mLeader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    ssize_t size = read(mLeader, buf, sizeof(buf));
+    if (size < (ssize_t)(3 * sizeof(uint64_t)) || buf[0] != (uint64_t)mMembers)
+        return false;
+
+    // Scale up if the group was multiplexed with other users of the PMU
+    uint64_t enabled = buf[1], running = buf[2];
+    for (int i = 0; i < mMembers; i++) {
+        uint64_t v = buf[3 + i];
+        if (running > 0 && running < enabled)
+            v = (uint64_t)((double)v * enabled / running);
+        values[mOrder[i]] = v;
+    }
+
+    return running > 0;
+}
@@ -61,7 +61,7 @@ PluginThread::~PluginThread()
     }
 }
 
-status_t PluginThread::readyToRun()
+status_t PluginThread::prepare()
 {
     const char *error;
     string lib;
@@ -185,7 +185,7 @@ status_t PluginThread::readyToRun()
         }
     }
 
-    return TestBase::readyToRun();
+    return TestBase::prepare();
 }
 
 void PluginThread::chooseEGLConfig(EGLDisplay display, EGLConfig *config)
@@ -200,6 +200,14 @@ void PluginThread::chooseEGLConfig(EGLDisplay display, EGLConfig *config)
         TestBase::chooseEGLConfig(display, config);
 }
 
+// A plugin's own choice may depend on its arguments as well
+string PluginThread::configKey()
+{
+    if (!mFuncs.chooseEGLConfig)
+        return TestBase::configKey();
+    return "plugin " + mSpec->content + " / " + TestBase::configKey();
+}
+
 EGLContext PluginThread::createEGLContext(EGLDisplay display, EGLConfig config)
 {
     EGLContext res = NULL;
@@ -229,8 +237,9 @@ bool PluginThread::pluginRender(bool& swap)
     if (ret == 1) {
         LOGD("\"%s\" plugin render requested reinit %d", mSpec->name.c_str(), ret);
 
-        // Do reinit
+        // Do reinit on the same display, letting the plugin choose again
         TestBase::freeEgl();
+        EglCache::get().forgetConfig(configKey());
         TestBase::initEgl();
         // Call render again with the new config
         ret = mFuncs.render(mData);
@@ -274,7 +283,7 @@ void PluginThread::updateContent()
             return;
         }
         if (swap)
-            eglSwapBuffers(mEglDisplay, mEglSurface);
+            swapBuffers();
 
         // Purge buffers
         if (!TestBase::purgeEglBuffers()) {
@@ -300,5 +309,5 @@ void PluginThread::updateContent()
         return;
     }
     if (swap)
-       eglSwapBuffers(mEglDisplay, mEglSurface);
+       swapBuffers();
 }
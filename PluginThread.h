@@ -54,11 +54,12 @@ class PluginThread : public TestBase {
         PluginThread(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
                 Mutex &exitLock, Condition &exitCondition);
         ~PluginThread();
-        virtual status_t readyToRun();
 
     protected:
+        virtual status_t prepare();
         virtual void updateContent();
         virtual void chooseEGLConfig(EGLDisplay display, EGLConfig *config);
+        virtual std::string configKey();
         virtual EGLContext createEGLContext(EGLDisplay display, EGLConfig config);
 
     private:
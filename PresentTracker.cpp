@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <utils/Log.h>
+
+#include "PresentTracker.h"
+
+using namespace android;
+using namespace std;
+
+PresentTracker::PresentTracker()
+    : mTimestamps(false), mPeriod(0), mAnchor(0), mNextId(0)
+{
+}
+
+void PresentTracker::init(sp<ANativeWindow> window, nsecs_t vsyncPeriod)
+{
+    mWindow = window;
+    mPeriod = vsyncPeriod;
+    mAnchor = systemTime();
+    mPending.clear();
+    mResolved.clear();
+
+#ifdef ADTF_HAVE_FRAME_TIMESTAMPS
+    mTimestamps = native_window_enable_frame_timestamps(window.get(), true) == 0;
+#else
+    mTimestamps = false;
+#endif
+}
+
+bool PresentTracker::synthetic()
+{
+    return !mTimestamps;
+}
+
+void PresentTracker::beginFrame()
+{
+#ifdef ADTF_HAVE_FRAME_TIMESTAMPS
+    if (mTimestamps && native_window_get_next_frame_id(mWindow.get(), &mNextId) != 0)
+        mNextId = 0;
+#endif
+}
+
+void PresentTracker::queued(nsecs_t when, bool behind)
+{
+    if (mTimestamps) {
+        if (mNextId == 0)
+            return;
+        // Frames the display never reports on must not pile up
+        if (mPending.size() >= MAX_PENDING)
+            mPending.erase(mPending.begin());
+        Frame f;
+        f.id = mNextId;
+        f.queued = when;
+        mPending.push_back(f);
+        mNextId = 0;
+        return;
+    }
+
+    if (mPeriod <= 0)
+        return;
+
+    // First vsync edge at or after when, which may be before the anchor
+    nsecs_t d = when - mAnchor;
+    nsecs_t edges = d >= 0 ? (d + mPeriod - 1) / mPeriod : -(-d / mPeriod);
+    nsecs_t latch = mAnchor + edges * mPeriod;
+    if (behind)
+        latch += mPeriod;
+    mResolved.push_back(latch + mPeriod - when);
+}
+
+void PresentTracker::vsync(nsecs_t when)
+{
+    mAnchor = when;
+}
+
+void PresentTracker::collect(Stat& stat)
+{
+    for (size_t i = 0; i < mResolved.size(); i++)
+        stat.presentDone(ns2us(mResolved[i]), true);
+    mResolved.clear();
+
+#ifdef ADTF_HAVE_FRAME_TIMESTAMPS
+    size_t keep = 0;
+    for (size_t i = 0; i < mPending.size(); i++) {
+        nsecs_t present = 0;
+        status_t res = native_window_get_frame_timestamps(mWindow.get(), mPending[i].id,
+                NULL, NULL, NULL, NULL, NULL, NULL, &present, NULL, NULL);
+
+        if (res == NO_ERROR && present == NATIVE_WINDOW_TIMESTAMP_PENDING)
+            mPending[keep++] = mPending[i];
+        else if (res == NO_ERROR && present > 0)
+            stat.presentDone(ns2us(present - mPending[i].queued), false);
+        // Invalid or evicted from the producer's history, drop it
+    }
+    mPending.resize(keep);
+#endif
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PRESENT_TRACKER_H
+#define _PRESENT_TRACKER_H
+
+#include <vector>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <system/window.h>
+
+#include "Stat.h"
+
+using namespace android;
+
+// Follows queued frames until they reach the display. Platforms with frame
+// timestamps (ADTF_HAVE_FRAME_TIMESTAMPS) report the real present time.
+// Elsewhere it is synthesized: a frame is latched on the first vsync after
+// it was queued, one period later for each buffer already waiting, and shown
+// on the vsync after that. The vsync grid starts out arbitrary and is pinned
+// to real vsync events when the surface receives them.
+class PresentTracker {
+    public:
+        PresentTracker();
+
+        void init(sp<ANativeWindow> window, nsecs_t vsyncPeriod);
+        bool synthetic();
+
+        // Bracket each content update; behind as sampled right after queueing
+        void beginFrame();
+        void queued(nsecs_t when, bool behind);
+
+        void vsync(nsecs_t when);
+
+        // Hands queue to present latencies that are known by now to stat
+        void collect(Stat& stat);
+
+    private:
+        enum { MAX_PENDING = 32 };
+
+        struct Frame {
+            uint64_t id;
+            nsecs_t queued;
+        };
+
+        sp<ANativeWindow> mWindow;
+        bool mTimestamps;
+        nsecs_t mPeriod;
+        nsecs_t mAnchor;
+        uint64_t mNextId;
+        std::vector<Frame> mPending;
+        std::vector<nsecs_t> mResolved;  // Synthetic latencies not yet collected
+};
+
+#endif
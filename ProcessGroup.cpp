@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "LocalTypes.h"
+#include "ProcessGroup.h"
+
+using namespace android;
+using namespace std;
+
+ProcessGroup::ProcessGroup(int procs) :
+    mProcs(procs > 0 ? procs : 1), mIndex(-1), mShared(NULL), mSize(0)
+{
+}
+
+ProcessGroup::~ProcessGroup()
+{
+    if (mShared != NULL)
+        munmap(mShared, mSize);
+}
+
+bool ProcessGroup::spawn()
+{
+    mSize = sizeof(Shared) + (mProcs - 1) * sizeof(Result);
+    void *p = mmap(NULL, mSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        LOGE("can't map %llu bytes shared between workers: %s", (unsigned long long)mSize,
+                strerror(errno));
+        mSize = 0;
+        return false;
+    }
+    mShared = (Shared*)p; // Zero filled
+
+    for (int i = 0; i < mProcs; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            mIndex = i;
+            mPids.clear();
+            return true;
+        }
+        if (pid < 0) {
+            LOGE("can't fork worker %d: %s", i, strerror(errno));
+            for (size_t j = 0; j < mPids.size(); j++)
+                kill(mPids[j], SIGKILL);
+            for (size_t j = 0; j < mPids.size(); j++)
+                waitpid(mPids[j], NULL, 0);
+            mPids.clear();
+            return false;
+        }
+        mPids.push_back(pid);
+    }
+
+    LOGD("forked %d workers", mProcs);
+    return true;
+}
+
+nsecs_t ProcessGroup::waitStart()
+{
+    // The last one in picks a start time a little ahead, so the others are
+    // polling again by then, and publishes it before opening the gate
+    if (__sync_add_and_fetch(&mShared->ready, 1) == mProcs) {
+        mShared->start = systemTime() + ms2ns(START_MARGIN_MS);
+        __sync_synchronize();
+        mShared->go = 1;
+    }
+
+    while (!mShared->go) {
+        if (mShared->aborted) {
+            LOGW("worker %d starting without the workers that failed", mIndex);
+            return systemTime();
+        }
+        usleep(1000);
+    }
+    __sync_synchronize();
+
+    nsecs_t start = mShared->start;
+    nsecs_t now = systemTime();
+    if (start > now)
+        usleep(ns2us(start - now));
+
+    LOGD("worker %d released, %lldus after the common start", mIndex,
+            (long long)ns2us(systemTime() - start));
+    return start;
+}
+
+void ProcessGroup::report(uint64_t frames, uint64_t misses, const Stat::Totals& totals,
+        nsecs_t duration)
+{
+    Result& r = mShared->results[mIndex];
+    r.frames = frames;
+    r.misses = misses;
+    r.totals = totals;
+    r.duration = ns2us(duration);
+    __sync_synchronize();
+    r.reported = 1;
+}
+
+void ProcessGroup::reap(pid_t pid, int status, bool& ok)
+{
+    int i = 0;
+    while (i < mProcs && mPids[i] != pid)
+        i++;
+    if (i == mProcs)
+        return;
+
+    if (WIFSIGNALED(status)) {
+        LOGE("worker %d (pid %d) killed by signal %d", i, pid, WTERMSIG(status));
+        ok = false;
+    } else if (WEXITSTATUS(status) != 0) {
+        LOGE("worker %d (pid %d) exited with status %d", i, pid, WEXITSTATUS(status));
+        ok = false;
+    }
+
+    // Don't leave the rest waiting for one that never arrives
+    if (!mShared->go)
+        mShared->aborted = 1;
+}
+
+bool ProcessGroup::wait()
+{
+    bool ok = true;
+
+    for (size_t left = mPids.size(); left > 0; ) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("waiting for workers failed: %s", strerror(errno));
+            return false;
+        }
+        reap(pid, status, ok);
+        left--;
+    }
+
+    uint64_t frames = 0, misses = 0;
+    Stat::Totals t;
+    int64_t duration = 0;
+    for (int i = 0; i < mProcs; i++) {
+        const Result& r = mShared->results[i];
+        if (!r.reported) {
+            LOGW("worker %d reported no results", i);
+            ok = false;
+            continue;
+        }
+        LOGI("stat worker %d f: %llu m: %llu r: %llu w: %llu u: %llu t: %llu d: %lld", i,
+                (unsigned long long)r.frames, (unsigned long long)r.misses,
+                (unsigned long long)r.totals.read, (unsigned long long)r.totals.written,
+                (unsigned long long)r.totals.updates,
+                (unsigned long long)r.totals.transactions, (long long)r.duration);
+        frames += r.frames;
+        misses += r.misses;
+        t.read += r.totals.read;
+        t.written += r.totals.written;
+        t.updates += r.totals.updates;
+        t.updateTime += r.totals.updateTime;
+        t.updateMax = max(t.updateMax, r.totals.updateMax);
+        t.transactions += r.totals.transactions;
+        t.transTime += r.totals.transTime;
+        t.transMax = max(t.transMax, r.totals.transMax);
+        duration = max(duration, r.duration);
+    }
+
+    // Workers share the start, so the longest one spans the whole run
+    if (duration > 0) {
+        LOGI("stat total %d workers f: %llu m: %llu (%.2f%%) r: %llu (%.1f MB/s) "
+                "w: %llu (%.1f MB/s) u: %llu/%llu/%llu t: %llu/%llu/%llu d: %lld", mProcs,
+                (unsigned long long)frames, (unsigned long long)misses,
+                frames > 0 ? 100.0 * misses / frames : 0.0,
+                (unsigned long long)t.read, (double)t.read / duration,
+                (unsigned long long)t.written, (double)t.written / duration,
+                (unsigned long long)t.updates,
+                (unsigned long long)(t.updates > 0 ? t.updateTime / t.updates : 0),
+                (unsigned long long)t.updateMax,
+                (unsigned long long)t.transactions,
+                (unsigned long long)(t.transactions > 0 ? t.transTime / t.transactions : 0),
+                (unsigned long long)t.transMax,
+                (long long)duration);
+    }
+
+    return ok;
+}
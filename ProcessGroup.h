@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PROCESS_GROUP_H
+#define _PROCESS_GROUP_H
+
+#include <sys/types.h>
+#include <vector>
+#include <utils/Timers.h>
+
+#include "Stat.h"
+
+using namespace android;
+
+// Runs the surfaces in several worker processes, each with its own composer
+// connection like separate apps have. The workers share one anonymous page
+// with the parent: a start barrier that releases them all at one monotonic
+// start time once the last has set up, and a result slot per worker that
+// the parent sums when they have exited. Forking has to happen before the
+// binder is opened, the workers open their own.
+class ProcessGroup {
+    public:
+        ProcessGroup(int procs);
+        ~ProcessGroup();
+
+        // Returns in the parent and in every worker, false if the shared
+        // page or a fork failed, in which case no worker is left running
+        bool spawn();
+
+        int procs() const { return mProcs; }
+        // Worker index, -1 in the parent
+        int index() const { return mIndex; }
+        bool isWorker() const { return mIndex >= 0; }
+
+        // Worker: waits for the others and returns the common start time.
+        // When a worker died before getting here the rest start right away.
+        nsecs_t waitStart();
+
+        // Worker: publishes its totals for the parent
+        void report(uint64_t frames, uint64_t misses, const Stat::Totals& totals,
+                nsecs_t duration);
+
+        // Parent: reaps the workers and reports their merged totals, false
+        // when a worker failed or did not report
+        bool wait();
+
+    private:
+        enum { START_MARGIN_MS = 20 };
+
+        struct Result {
+            uint64_t frames;
+            uint64_t misses;
+            Stat::Totals totals;
+            int64_t duration;   // us
+            volatile int32_t reported;
+        };
+
+        struct Shared {
+            volatile int32_t ready;
+            volatile int32_t go;
+            volatile int32_t aborted;
+            int64_t start;      // Valid once go is set
+            Result results[1];  // procs of them
+        };
+
+        void reap(pid_t pid, int status, bool& ok);
+
+        int mProcs;
+        int mIndex;
+        Shared *mShared;
+        size_t mSize;
+        std::vector<pid_t> mPids;
+};
+
+#endif
@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FileThread.h"
+#include "FrameCodec.h"
+#include "FrameDecoder.h"
+#include "RefCompositor.h"
+
+using namespace android;
+using namespace std;
+
+#define OPAQUE_BLACK 0xff000000
+
+RefCompositor::RefCompositor(int width, int height, unsigned int threads) :
+    mWidth(width), mHeight(height), mGeneration(0), mBusy(0), mStopping(false)
+{
+    mFrame.assign((size_t)width * height, OPAQUE_BLACK);
+
+    unsigned int tiles = (height + TILE_ROWS - 1) / TILE_ROWS;
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+    threads = min(threads, max(tiles, 1u));
+
+    // With a single thread the caller composes, no point in handing over
+    if (threads < 2)
+        return;
+
+    mSeen.assign(threads, 0);
+    for (unsigned int i = 0; i < threads; i++) {
+        sp<Worker> w = new Worker(this, i);
+        if (w->run("adtf compositor") != NO_ERROR) {
+            LOGW("compositor runs with %u of %u threads", i, threads);
+            break;
+        }
+        mWorkers.push_back(w);
+    }
+}
+
+RefCompositor::~RefCompositor()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        mStopping = true;
+        mCondition.broadcast();
+    }
+    for (size_t i = 0; i < mWorkers.size(); i++)
+        mWorkers[i]->requestExitAndWait();
+
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        Layer *l = mLayers[i];
+        delete l->source;
+        if (l->clip != NULL)
+            munmap((void*)l->clip, l->clipLength);
+        delete l;
+    }
+}
+
+static bool hasAlpha(PixelFormat format)
+{
+    switch (format) {
+        case PIXEL_FORMAT_TRANSLUCENT:
+        case PIXEL_FORMAT_TRANSPARENT:
+        case PIXEL_FORMAT_RGBA_8888:
+        case PIXEL_FORMAT_BGRA_8888:
+        case PIXEL_FORMAT_RGBA_5551:
+        case PIXEL_FORMAT_RGBA_4444:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool hintBefore(const Rect& a, const Rect& b)
+{
+    return a.left < b.left;
+}
+
+static bool layerBelow(const sp<SurfaceSpec>& a, const sp<SurfaceSpec>& b)
+{
+    return a->zOrder < b->zOrder;
+}
+
+bool RefCompositor::addSurface(sp<SurfaceSpec> spec)
+{
+    if (spec->flags & ISurfaceComposer::eHidden) {
+        LOGD("\"%s\" hidden, not composed", spec->name.c_str());
+        return true;
+    }
+
+    Layer *l = new Layer();
+    l->spec = spec;
+    l->color = 0;
+    l->clip = NULL;
+    l->clipLength = 0;
+    l->source = NULL;
+    l->frameSize = 0;
+    l->frames = 0;
+    l->frame = 0;
+
+    // Surfaces without an output rect are their source size, as on screen
+    l->dst = spec->outRect;
+    if (l->dst.width() <= 0)
+        l->dst.right = l->dst.left + spec->srcGeometry.width;
+    if (l->dst.height() <= 0)
+        l->dst.bottom = l->dst.top + spec->srcGeometry.height;
+    l->blend = hasAlpha(spec->format) && (spec->flags & ISurfaceComposer::eOpaque) == 0;
+
+    for (List<Rect>::iterator it = spec->transparentRegionHint.begin();
+            it != spec->transparentRegionHint.end(); ++it)
+        l->hints.push_back(Rect(it->left + l->dst.left, it->top + l->dst.top,
+                it->right + l->dst.left, it->bottom + l->dst.top));
+    sort(l->hints.begin(), l->hints.end(), hintBefore);
+
+    bool ok = true;
+    l->width = l->height = 1;
+    switch (spec->contentType) {
+        case ContentType::SOLID: {
+            string color;
+            stringstream ss(spec->content);
+            while (ss >> color)
+                l->colors.push_back(color == "random" ? ULONG_MAX + 1 : strtoull(color.c_str(), NULL, 16));
+            if (l->colors.empty())
+                l->colors.push_back(ULONG_MAX + 1);
+            break;
+        }
+        case ContentType::FILE:
+            l->width = spec->srcGeometry.width;
+            l->height = spec->srcGeometry.height;
+            ok = openClip(l);
+            break;
+        default:
+            // Plugins draw with GL, a flat gray stands in for them
+            LOGW("\"%s\" plugin content composed as gray", spec->name.c_str());
+            l->pixels.assign(1, 0xff808080);
+            break;
+    }
+
+    if (!ok || l->width <= 0 || l->height <= 0 || l->dst.isEmpty()) {
+        LOGE("\"%s\" can't be composed", spec->name.c_str());
+        delete l->source;
+        if (l->clip != NULL)
+            munmap((void*)l->clip, l->clipLength);
+        delete l;
+        return false;
+    }
+
+    mapGeometry(l);
+
+    // Equal z-order keeps the case file order
+    vector<Layer*>::iterator it = mLayers.begin();
+    while (it != mLayers.end() && !layerBelow(spec, (*it)->spec))
+        it++;
+    mLayers.insert(it, l);
+    return true;
+}
+
+bool RefCompositor::openClip(Layer *l)
+{
+    sp<SurfaceSpec> spec = l->spec;
+    string fileName;
+    size_t frames = 0;
+    stringstream ss(spec->content);
+    ss >> fileName;
+    ss >> frames;
+
+    l->frameSize = FileThread::frameSize(spec);
+    if (l->frameSize == 0)
+        return false;
+
+    if (FrameCodec::isCoded(fileName)) {
+        FrameDecoder *decoder = new FrameDecoder(spec->name);
+        l->source = decoder;
+        if (!decoder->open(fileName, l->frameSize))
+            return false;
+        l->frames = decoder->frames();
+    } else {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            LOGE("\"%s\" can't open '%s'", spec->name.c_str(), fileName.c_str());
+            return false;
+        }
+        struct stat sb;
+        if (fstat(fd, &sb) != 0 || sb.st_size == 0 || sb.st_size % l->frameSize != 0) {
+            LOGE("\"%s\" '%s' doesn't contain an integer number of %u byte frames",
+                    spec->name.c_str(), fileName.c_str(), l->frameSize);
+            close(fd);
+            return false;
+        }
+        l->clipLength = sb.st_size;
+        void *p = mmap(NULL, l->clipLength, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            LOGE("\"%s\" mmap failed '%s': %s", spec->name.c_str(), fileName.c_str(),
+                    strerror(errno));
+            return false;
+        }
+        l->clip = (const uint8_t*)p;
+        l->frames = l->clipLength / l->frameSize;
+    }
+
+    if (frames > 0)
+        l->frames = min(frames, l->frames);
+
+    // One decoder thread, the compositor workers are what is being measured
+    FrameDecoder *decoder = static_cast<FrameDecoder*>(l->source);
+    return decoder == NULL || decoder->start(l->frames, 2, 1);
+}
+
+// Source pixel for every output row and column, from the output rect back
+// through transform and crop. Rotation swaps which of the two picks the
+// source row.
+void RefCompositor::mapGeometry(Layer *l)
+{
+    const int w = l->dst.width(), h = l->dst.height();
+    const int tr = l->spec->transform;
+    const bool rot = (tr & HAL_TRANSFORM_ROT_90) != 0;
+    const bool flipH = (tr & HAL_TRANSFORM_FLIP_H) != 0;
+    const bool flipV = (tr & HAL_TRANSFORM_FLIP_V) != 0;
+
+    Rect crop(0, 0, l->width, l->height);
+    const Rect& c = l->spec->srcGeometry.crop;
+    if (l->spec->contentType == ContentType::FILE && c.isValid() && !c.isEmpty()) {
+        crop.left = max(0, min(c.left, l->width - 1));
+        crop.top = max(0, min(c.top, l->height - 1));
+        crop.right = max(crop.left + 1, min(c.right, l->width));
+        crop.bottom = max(crop.top + 1, min(c.bottom, l->height));
+    }
+    const int cw = crop.width(), ch = crop.height();
+
+    l->colOffsets.resize(w);
+    for (int x = 0; x < w; x++) {
+        double u = (x + 0.5) / w;
+        if (!rot) {
+            int sx = min((int)((flipH ? 1 - u : u) * cw), cw - 1);
+            l->colOffsets[x] = crop.left + sx;
+        } else {
+            int sy = min((int)((flipV ? u : 1 - u) * ch), ch - 1);
+            l->colOffsets[x] = (crop.top + sy) * l->width;
+        }
+    }
+
+    l->rowOffsets.resize(h);
+    for (int y = 0; y < h; y++) {
+        double v = (y + 0.5) / h;
+        if (!rot) {
+            int sy = min((int)((flipV ? 1 - v : v) * ch), ch - 1);
+            l->rowOffsets[y] = (crop.top + sy) * l->width;
+        } else {
+            int sx = min((int)((flipH ? 1 - v : v) * cw), cw - 1);
+            l->rowOffsets[y] = crop.left + sx;
+        }
+    }
+}
+
+// The surface's next buffer, as its update thread would have queued it
+bool RefCompositor::queue(Layer *l)
+{
+    const sp<SurfaceSpec>& spec = l->spec;
+
+    if (spec->contentType == ContentType::SOLID) {
+        unsigned long long v = l->colors[l->color];
+        l->color = (l->color + 1) % l->colors.size();
+
+        // Raw pixel bytes as SolidThread writes them
+        uint8_t c[4];
+        int bpp = spec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12 ? 2 :
+            spec->bufferFormat == HAL_PIXEL_FORMAT_TI_BGRX ? 4 : bytesPerPixel(spec->format);
+        if (v == ULONG_MAX + 1) {
+            for (int i = 0; i < 4; i++)
+                c[i] = rand() % 255;
+        } else {
+            v = v << ((4 - min(max(bpp, 1), 4)) * 8);
+            for (int i = 0; i < 4; i++)
+                c[i] = v >> ((3 - i) * 8);
+        }
+        if (spec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12) {
+            uint8_t nv12[3] = { c[0], c[1], c[1] };
+            return convert(l, nv12);
+        }
+        return convert(l, c);
+    }
+
+    if (spec->contentType != ContentType::FILE)
+        return true;
+
+    const uint8_t *src;
+    if (l->source != NULL) {
+        bool waited;
+        src = (const uint8_t*)l->source->acquire(waited);
+        if (src == NULL)
+            return false;
+    } else {
+        src = l->clip + l->frame * l->frameSize;
+    }
+
+    bool ok = convert(l, src);
+
+    if (l->source != NULL)
+        l->source->release();
+    l->frame = (l->frame + 1) % l->frames;
+    return ok;
+}
+
+static inline uint8_t clamp8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// Raw frame in the buffer format to RGBA, R in the low byte
+bool RefCompositor::convert(Layer *l, const uint8_t *src)
+{
+    const int w = l->width, h = l->height;
+    const int stride = l->spec->contentType == ContentType::FILE ?
+        l->spec->srcGeometry.stride : w;
+    l->pixels.resize((size_t)w * h);
+    uint32_t *out = &l->pixels[0];
+
+    switch (l->spec->bufferFormat) {
+        case PIXEL_FORMAT_RGBA_8888:
+        case PIXEL_FORMAT_RGBX_8888: {
+            const uint32_t alpha = l->spec->bufferFormat == PIXEL_FORMAT_RGBX_8888 ? OPAQUE_BLACK : 0;
+            for (int y = 0; y < h; y++, src += stride * 4, out += w) {
+                memcpy(out, src, w * 4);
+                for (int x = 0; x < w; x++)
+                    out[x] |= alpha;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_BGRA_8888:
+        case HAL_PIXEL_FORMAT_TI_BGRX: {
+            const uint32_t alpha = l->spec->bufferFormat == HAL_PIXEL_FORMAT_TI_BGRX ? OPAQUE_BLACK : 0;
+            for (int y = 0; y < h; y++, src += stride * 4, out += w) {
+                memcpy(out, src, w * 4);
+                for (int x = 0; x < w; x++) {
+                    uint32_t v = out[x];
+                    out[x] = (v & 0xff00ff00) | ((v >> 16) & 0xff) | ((v & 0xff) << 16) | alpha;
+                }
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB_888:
+            for (int y = 0; y < h; y++, src += stride * 3, out += w)
+                for (int x = 0; x < w; x++)
+                    out[x] = OPAQUE_BLACK | src[x * 3] | (src[x * 3 + 1] << 8) |
+                        (src[x * 3 + 2] << 16);
+            break;
+        case PIXEL_FORMAT_RGB_565:
+            for (int y = 0; y < h; y++, src += stride * 2, out += w) {
+                for (int x = 0; x < w; x++) {
+                    uint32_t v = src[x * 2] | (src[x * 2 + 1] << 8);
+                    uint32_t r = (v >> 11) & 0x1f, g = (v >> 5) & 0x3f, b = v & 0x1f;
+                    out[x] = OPAQUE_BLACK | ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) |
+                        (((b << 3) | (b >> 2)) << 16);
+                }
+            }
+            break;
+        case HAL_PIXEL_FORMAT_TI_NV12: {
+            // BT.601 video range
+            const uint8_t *uvPlane = src + stride * h;
+            for (int y = 0; y < h; y++, out += w) {
+                const uint8_t *yl = src + y * stride, *uv = uvPlane + (y / 2) * stride;
+                for (int x = 0; x < w; x++) {
+                    int c = 298 * (yl[x] - 16) + 128;
+                    int d = uv[x & ~1] - 128, e = uv[x | 1] - 128;
+                    out[x] = OPAQUE_BLACK | clamp8((c + 409 * e) >> 8) |
+                        (clamp8((c - 100 * d - 208 * e) >> 8) << 8) |
+                        (clamp8((c + 516 * d) >> 8) << 16);
+                }
+            }
+            break;
+        }
+        default:
+            LOGE("\"%s\" format %d not supported by the reference compositor",
+                    l->spec->name.c_str(), l->spec->bufferFormat);
+            return false;
+    }
+    return true;
+}
+
+nsecs_t RefCompositor::compose()
+{
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        if (!queue(mLayers[i]) && !mLayers[i]->pixels.empty())
+            LOGW("\"%s\" no new frame, composing the last one", mLayers[i]->spec->name.c_str());
+    }
+
+    nsecs_t start = systemTime();
+    if (mWorkers.empty()) {
+        for (unsigned int t = 0; t < (mHeight + TILE_ROWS - 1) / TILE_ROWS; t++)
+            composeTile(t);
+    } else {
+        Mutex::Autolock _l(mLock);
+        mBusy = mWorkers.size();
+        mGeneration++;
+        mCondition.broadcast();
+        while (mBusy > 0)
+            mCondition.wait(mLock);
+    }
+    return systemTime() - start;
+}
+
+bool RefCompositor::work(unsigned int worker)
+{
+    {
+        Mutex::Autolock _l(mLock);
+        while (mSeen[worker] == mGeneration && !mStopping)
+            mCondition.wait(mLock);
+        if (mStopping)
+            return false;
+        mSeen[worker] = mGeneration;
+    }
+
+    const unsigned int tiles = (mHeight + TILE_ROWS - 1) / TILE_ROWS;
+    for (unsigned int t = worker; t < tiles; t += mWorkers.size())
+        composeTile(t);
+
+    Mutex::Autolock _l(mLock);
+    if (--mBusy == 0)
+        mCondition.broadcast();
+    return true;
+}
+
+void RefCompositor::composeTile(unsigned int tile)
+{
+    const int y0 = tile * TILE_ROWS, y1 = min(y0 + (int)TILE_ROWS, mHeight);
+
+    for (int y = y0; y < y1; y++) {
+        uint32_t *out = &mFrame[(size_t)y * mWidth];
+        fill(out, out + mWidth, (uint32_t)OPAQUE_BLACK);
+
+        for (size_t i = 0; i < mLayers.size(); i++) {
+            const Layer *l = mLayers[i];
+            if (y < l->dst.top || y >= l->dst.bottom || l->pixels.empty())
+                continue;
+
+            const int x0 = max(l->dst.left, 0), x1 = min(l->dst.right, mWidth);
+            if (x0 >= x1)
+                continue;
+
+            // Leave out what the hints say is transparent
+            int x = x0;
+            for (size_t j = 0; j < l->hints.size() && x < x1; j++) {
+                const Rect& r = l->hints[j];
+                if (y < r.top || y >= r.bottom || r.right <= x)
+                    continue;
+                if (r.left >= x1)
+                    break;
+                if (r.left > x)
+                    composeSpan(l, out, y, x, r.left);
+                x = max(x, r.right);
+            }
+            if (x < x1)
+                composeSpan(l, out, y, x, x1);
+        }
+    }
+}
+
+// Pixels [x0, x1) of output row y. Blending works on red and blue together
+// and on green separately, with alpha scaled to 0-256 so that opaque and
+// transparent are exact. Source pixels are gathered one at a time through
+// the column table, so this is plain scalar code, not SIMD; it only packs
+// two channels per multiply.
+void RefCompositor::composeSpan(const Layer *l, uint32_t *out, int y, int x0, int x1)
+{
+    const uint32_t *src = &l->pixels[l->rowOffsets[y - l->dst.top]];
+    const uint32_t *cols = &l->colOffsets[x0 - l->dst.left];
+    uint32_t *d = out + x0;
+    const int n = x1 - x0;
+
+    if (!l->blend) {
+        for (int i = 0; i < n; i++)
+            d[i] = src[cols[i]];
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint32_t s = src[cols[i]], t = d[i];
+        uint32_t a = s >> 24;
+        a += a >> 7;
+        uint32_t ia = 256 - a;
+        uint32_t rb = (((s & 0xff00ff) * a + (t & 0xff00ff) * ia) >> 8) & 0xff00ff;
+        uint32_t g = (((s & 0x00ff00) * a + (t & 0x00ff00) * ia) >> 8) & 0x00ff00;
+        d[i] = OPAQUE_BLACK | rb | g;
+    }
+}
+
+bool RefCompositor::writeFrame(string path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+        LOGE("unable to open '%s' for writing", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(&mFrame[0], sizeof(uint32_t), mFrame.size(), f) == mFrame.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        LOGE("unable to write '%s': %s", path.c_str(), strerror(errno));
+    return ok;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _REF_COMPOSITOR_H
+#define _REF_COMPOSITOR_H
+
+#include <string>
+#include <vector>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "FrameSource.h"
+#include "LocalTypes.h"
+
+using namespace android;
+
+// Software stand-in for the display compositor, for running a case without
+// a display. Each frame every surface "queues" its next content, converted
+// to RGBA, and the surfaces are blended into an RGBA framebuffer by z-order,
+// honoring output rect, crop, transform, transparent region hints and
+// format alpha. The framebuffer is split into tiles of rows, composed in
+// parallel by worker threads. Sampling is nearest neighbour: the point is
+// the cost and a plausible image, not a pixel exact match with the GPU.
+// It is part of the adtf binary and runs on the device, there is no host
+// build of it.
+class RefCompositor {
+    public:
+        RefCompositor(int width, int height, unsigned int threads);
+        ~RefCompositor();
+
+        bool addSurface(sp<SurfaceSpec> spec);
+
+        // Queues the next frame of every surface and composes them, returns
+        // the time spent composing
+        nsecs_t compose();
+
+        bool writeFrame(std::string path);
+
+    private:
+        enum { TILE_ROWS = 32 };
+
+        struct Layer {
+            sp<SurfaceSpec> spec;
+            Rect dst;
+            bool blend;
+            std::vector<Rect> hints;        // Output coordinates
+
+            // Latest queued buffer, RGBA
+            std::vector<uint32_t> pixels;
+            int width;
+            int height;
+
+            // Pixel offset into pixels for each output row and column
+            std::vector<uint32_t> rowOffsets;
+            std::vector<uint32_t> colOffsets;
+
+            // Solid content
+            std::vector<unsigned long long> colors;
+            size_t color;
+
+            // File content, mapped or decoded
+            const uint8_t *clip;
+            size_t clipLength;
+            FrameSource *source;
+            size_t frameSize;
+            size_t frames;
+            size_t frame;
+        };
+
+        class Worker : public Thread {
+            public:
+                Worker(RefCompositor *compositor, unsigned int index) :
+                    Thread(false), mCompositor(compositor), mIndex(index) {}
+            private:
+                virtual bool threadLoop() { return mCompositor->work(mIndex); }
+                RefCompositor *mCompositor;
+                unsigned int mIndex;
+        };
+
+        bool openClip(Layer *l);
+        void mapGeometry(Layer *l);
+        bool queue(Layer *l);
+        bool convert(Layer *l, const uint8_t *src);
+
+        bool work(unsigned int worker);
+        void composeTile(unsigned int tile);
+        void composeSpan(const Layer *l, uint32_t *out, int y, int x0, int x1);
+
+        int mWidth;
+        int mHeight;
+        std::vector<uint32_t> mFrame;
+        std::vector<Layer*> mLayers;    // Bottom to top
+
+        Mutex mLock;
+        Condition mCondition;
+        std::vector<sp<Worker> > mWorkers;
+        std::vector<uint64_t> mSeen;    // Last generation each worker composed
+        uint64_t mGeneration;
+        unsigned int mBusy;
+        bool mStopping;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <iostream>
+#include <sstream>
+
+#include "Saturation.h"
+#include "ThreadManager.h"
+
+using namespace android;
+using namespace std;
+
+bool Saturation::parseMode(string name, Mode *mode)
+{
+    if (name == "surfaces")
+        *mode = SURFACES;
+    else if (name == "latency")
+        *mode = LATENCY;
+    else if (name == "size")
+        *mode = SIZE;
+    else
+        return false;
+    return true;
+}
+
+Saturation::Saturation(sp<SurfaceSpec> tmpl, Mode mode, double threshold,
+        int maxSteps, int stepSize)
+    : mTemplate(tmpl), mMode(mode), mThreshold(threshold),
+    mMaxSteps(maxSteps), mStepSize(stepSize)
+{
+}
+
+void Saturation::buildStep(int step, List<sp<SurfaceSpec> >& specs)
+{
+    specs.clear();
+
+    if (mMode == SURFACES) {
+        int count = mStepSize * (step + 1);
+        for (int i = 0; i < count; i++) {
+            sp<SurfaceSpec> spec = mTemplate->clone();
+            stringstream ss;
+            ss << mTemplate->name << "_" << i;
+            spec->name = ss.str();
+            spec->zOrder = mTemplate->zOrder + i;
+            specs.push_back(spec);
+        }
+        return;
+    }
+
+    // Latency shrinks and size grows by mStepSize percent per step
+    double factor = 1.0;
+    for (int i = 0; i < step; i++)
+        factor *= mMode == LATENCY ? (100 - mStepSize) / 100.0 : (100 + mStepSize) / 100.0;
+
+    sp<SurfaceSpec> spec = mTemplate->clone();
+    if (mMode == LATENCY) {
+        spec->updateParams.latency = (unsigned int)(mTemplate->updateParams.latency * factor);
+    } else {
+        int w = mTemplate->outRect.width();
+        int h = mTemplate->outRect.height();
+        if (w <= 0)
+            w = mTemplate->srcGeometry.width;
+        if (h <= 0)
+            h = mTemplate->srcGeometry.height;
+        spec->outRect = Rect(mTemplate->outRect.left, mTemplate->outRect.top,
+                mTemplate->outRect.left + (int)(w * factor),
+                mTemplate->outRect.top + (int)(h * factor));
+    }
+    specs.push_back(spec);
+}
+
+string Saturation::describe(List<sp<SurfaceSpec> >& specs)
+{
+    stringstream ss;
+    sp<SurfaceSpec> spec = *specs.begin();
+
+    if (mMode == SURFACES)
+        ss << specs.size() << " surfaces";
+    else if (mMode == LATENCY)
+        ss << "latency " << spec->updateParams.latency << "us";
+    else
+        ss << "output " << spec->outRect.width() << "x" << spec->outRect.height();
+    return ss.str();
+}
+
+bool Saturation::run()
+{
+    if (mTemplate->updateParams.latency == 0) {
+        LOGE("\"%s\" saturation search needs update_latency > 0 for deadlines",
+                mTemplate->name.c_str());
+        cout << "saturation search needs update_latency > 0" << endl;
+        return false;
+    }
+
+    // Each step has to end by itself for the next one to start
+    if (mTemplate->updateParams.iterations < 0) {
+        LOGE("\"%s\" saturation search needs update_iterations >= 0",
+                mTemplate->name.c_str());
+        cout << "saturation search needs update_iterations >= 0" << endl;
+        return false;
+    }
+
+    if (mStepSize <= 0) {
+        LOGE("saturation step must be positive, got %d", mStepSize);
+        cout << "saturation step must be positive" << endl;
+        return false;
+    }
+
+    if (mMode != SURFACES && mStepSize >= 100) {
+        LOGE("saturation step must be 1-99 percent, got %d", mStepSize);
+        cout << "saturation step must be 1-99 percent" << endl;
+        return false;
+    }
+
+    string best;
+    int step;
+    for (step = 0; step < mMaxSteps; step++) {
+        List<sp<SurfaceSpec> > specs;
+        buildStep(step, specs);
+
+        if (mMode == LATENCY && (*specs.begin())->updateParams.latency == 0)
+            break;
+
+        string load = describe(specs);
+        LOGI("saturation step %d: %s", step, load.c_str());
+
+        sp<ThreadManager> mgr(new ThreadManager(specs));
+        mgr->run();
+        mgr->join();
+
+        uint64_t frames, misses;
+        mgr->getFrameCounts(frames, misses);
+        if (frames == 0) {
+            LOGE("saturation step %d produced no frames", step);
+            cout << "step " << step << " (" << load << ") produced no frames" << endl;
+            return false;
+        }
+
+        double rate = 100.0 * misses / frames;
+        LOGI("saturation step %d: %s missed %llu/%llu (%.2f%%)", step, load.c_str(),
+                (unsigned long long)misses, (unsigned long long)frames, rate);
+        cout << "step " << step << ": " << load << " missed " << misses << "/"
+            << frames << " (" << rate << "%)" << endl;
+
+        if (rate > mThreshold)
+            break;
+        best = load;
+    }
+
+    if (best.empty()) {
+        cout << "saturated at first step, threshold " << mThreshold << "%" << endl;
+    } else {
+        cout << "max sustainable load: " << best << " (threshold " << mThreshold << "%";
+        if (step == mMaxSteps)
+            cout << ", step limit reached";
+        cout << ")" << endl;
+    }
+    LOGI("saturation result: '%s'", best.c_str());
+
+    return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SATURATION_H
+#define _SATURATION_H
+
+#include <string>
+#include <utils/List.h>
+
+#include "LocalTypes.h"
+
+using namespace android;
+
+// Capacity benchmark: runs a template surface at increasing load until the
+// fraction of iterations missing their update_latency deadline exceeds a
+// threshold, then reports the last load that stayed below it.
+class Saturation {
+    public:
+        enum Mode { SURFACES, LATENCY, SIZE };
+
+        static bool parseMode(std::string name, Mode *mode);
+
+        Saturation(sp<SurfaceSpec> tmpl, Mode mode, double threshold,
+                int maxSteps, int stepSize);
+
+        bool run();
+
+    private:
+        void buildStep(int step, List<sp<SurfaceSpec> >& specs);
+        std::string describe(List<sp<SurfaceSpec> >& specs);
+
+        sp<SurfaceSpec> mTemplate;
+        Mode mMode;
+        double mThreshold; // Percent of iterations
+        int mMaxSteps;
+        int mStepSize; // Surfaces per step, or percent for latency/size
+};
+
+#endif
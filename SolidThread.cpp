@@ -44,7 +44,7 @@ SolidThread::SolidThread(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
 {
 }
 
-status_t SolidThread::readyToRun()
+status_t SolidThread::prepare()
 {
     string color;
     stringstream ss(stringstream::in | stringstream::out);
@@ -100,38 +100,98 @@ status_t SolidThread::readyToRun()
         return UNKNOWN_ERROR;
     }
 
-    return TestBase::readyToRun();
+    return TestBase::prepare();
 }
 
-void SolidThread::updateContent()
+// Next color in the list as raw bytes, assuming no more than 4 bytes per pixel
+void SolidThread::nextColor(uint8_t c[4])
 {
     unsigned long long v = mColors.itemAt(0);
     mColors.removeAt(0);
     mColors.push_back(v);
 
-    // Assuming no more than 4 bytes per pixel
-    uint8_t b0, b1, b2, b3;
-
     if (v == (ULONG_MAX + 1)) {
-        b0 = rand() % 255;
-        b1 = rand() % 255;
-        b2 = rand() % 255;
-        b3 = rand() % 255;
+        c[0] = rand() % 255;
+        c[1] = rand() % 255;
+        c[2] = rand() % 255;
+        c[3] = rand() % 255;
     } else {
         v = v << ((4 - mBpp) * 8);
-        b0 = (v & 0xFF000000) >> 24;
-        b1 = (v & 0x00FF0000) >> 16;
-        b2 = (v & 0x0000FF00) >> 8;
-        b3 = (v & 0x000000FF);
+        c[0] = (v & 0xFF000000) >> 24;
+        c[1] = (v & 0x00FF0000) >> 16;
+        c[2] = (v & 0x0000FF00) >> 8;
+        c[3] = (v & 0x000000FF);
+    }
+}
+
+uint64_t SolidThread::fillNV12(ANativeWindowBuffer *b, char *y, char *uv, const uint8_t c[4])
+{
+    int i, strides = b->height;
+    for (i = 0; i < strides; i++, y += b->stride)
+        memset(y, c[0], b->width);
+    strides /= 2;
+    for (i = 0; i < strides; i++, uv += b->stride)
+        memset(uv, c[1], b->width);
+    return b->width * (b->height + strides);
+}
+
+// Fills w x h pixels with stride in pixels, returns bytes of the source line
+uint64_t SolidThread::fillRGB(char *dst, uint32_t w, uint32_t h, uint32_t stride,
+        const uint8_t c[4])
+{
+    unsigned int sl = w * mBpp;
+    char line [sl];
+    for (uint32_t x = 0, i = 0; x < w; x++, i = x * mBpp) {
+        switch (mBpp) {
+            case 4:
+                line[i + 3] = c[3];
+            case 3:
+                line[i + 2] = c[2];
+            case 2:
+                line[i + 1] = c[1];
+            case 1:
+                line[i] = c[0];
+                break;
+            default:
+                break;
+        }
+    }
+
+    unsigned int dl = stride * mBpp;
+    for (unsigned int i = 0; i < h; i++, dst += dl)
+        memcpy(dst, line, sl);
+    return sl;
+}
+
+bool SolidThread::fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+        uint64_t& read, uint64_t& written)
+{
+    uint8_t c[4];
+    nextColor(c);
+
+    if (uv != 0) {
+        written = fillNV12(b, bits, uv, c);
+        return true;
     }
 
+    read = fillRGB(bits, b->width, b->height, b->stride, c);
+    written = b->height * read;
+    return true;
+}
+
+void SolidThread::updateContent()
+{
+    uint8_t c[4];
+    nextColor(c);
+
     sp<Surface> s = mSurfaceControl->getSurface();
 
     if (mSpec->renderFlag(RenderFlags::GL)) {
         // Though a bit unintuitive, always interprete bytes as RBGA for gl for simplicity
-        glClearColor(b0 / 255.0, b1 / 255.0, b2 / 255.0, b3 / 255.0);
+        glClearColor(c[0] / 255.0, c[1] / 255.0, c[2] / 255.0, c[3] / 255.0);
         glClear(GL_COLOR_BUFFER_BIT);
-        eglSwapBuffers(mEglDisplay, mEglSurface);
+        swapBuffers();
+        accountBytes(0, mWidth * mHeight * bufferBpp());
         return;
     }
 
@@ -146,12 +206,8 @@ void SolidThread::updateContent()
             return;
         }
 
-        int i, strides = b->height;
-        for (i = 0; i < strides; i++, y += b->stride)
-            memset(y, b0, b->width);
-        strides /= 2;
-        for (i = 0; i < strides; i++, uv += b->stride)
-            memset(uv, b1, b->width);
+        accountBytes(0, fillNV12(b, y, uv, c));
+        captureBuffer(y, uv, b->stride, b->width, b->height);
 
         mapper.unlock(b->handle);
         window.get()->queueBuffer(window.get(), b);
@@ -160,33 +216,14 @@ void SolidThread::updateContent()
 
     Surface::SurfaceInfo info;
 
-    if (s->lock(&info) != NO_ERROR) {
+    if (lockSurface(s, &info) != NO_ERROR) {
         LOGE("\"%s\" failed to lock surface", mSpec->name.c_str());
         requestExit();
         return;
     }
 
-    unsigned int sl = info.w * mBpp;
-    char line [sl];
-    for (uint32_t x = 0, i = 0; x < info.w; x++, i = x * mBpp) {
-        switch (mBpp) {
-            case 4:
-                line[i + 3] = b3;
-            case 3:
-                line[i + 2] = b2;
-            case 2:
-                line[i + 1] = b1;
-            case 1:
-                line[i] = b0;
-                break;
-            default:
-                break;
-        }
-    }
-
-    char* dst = reinterpret_cast<char*>(info.bits);
-    unsigned int dl = info.s * mBpp;
-    for (unsigned int i = 0; i < info.h; i++, dst += dl)
-        memcpy(dst, line, sl);
+    uint64_t sl = fillRGB(reinterpret_cast<char*>(info.bits), info.w, info.h, info.s, c);
+    accountBytes(sl, info.h * sl); // Source line stays in cache
+    captureBuffer(reinterpret_cast<char*>(info.bits), 0, info.s, info.w, info.h);
     s->unlockAndPost();
 }
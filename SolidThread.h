@@ -42,12 +42,19 @@ class SolidThread : public TestBase {
     public:
         SolidThread(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
                 Mutex &exitLock, Condition &exitCondition);
-        virtual status_t readyToRun();
 
     protected:
+        virtual status_t prepare();
         virtual void updateContent();
+        virtual bool fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+                uint64_t& read, uint64_t& written);
 
     private:
+        void nextColor(uint8_t c[4]);
+        uint64_t fillNV12(ANativeWindowBuffer *b, char *y, char *uv, const uint8_t c[4]);
+        uint64_t fillRGB(char *dst, uint32_t w, uint32_t h, uint32_t stride,
+                const uint8_t c[4]);
+
         Vector<unsigned long long> mColors;
         int mBpp;
 };
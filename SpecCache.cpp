@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SpecCache.h"
+#include "SpecParser.h"
+
+using namespace android;
+using namespace std;
+
+#define CACHE_MAGIC 0x43465441 // "ATFC"
+
+// Bump whenever a SurfaceSpec field or the record layout below changes
+#define CACHE_VERSION 11
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t count;     // Surface records following the header
+    uint32_t size;      // Total file size, catches truncated writes
+};
+
+// Records are a flat sequence of 32 bit fields, 64 bit fields and length
+// prefixed strings in SurfaceSpec order, in host byte order. The cache is
+// only read back on the device that wrote it.
+class CacheWriter {
+    public:
+        void put32(uint32_t v)
+        {
+            mBuf.append((const char*)&v, sizeof(v));
+        }
+
+        void put64(uint64_t v)
+        {
+            mBuf.append((const char*)&v, sizeof(v));
+        }
+
+        void putString(const string& s)
+        {
+            put32(s.size());
+            mBuf.append(s);
+        }
+
+        void putRect(const Rect& r)
+        {
+            put32(r.left);
+            put32(r.top);
+            put32(r.right);
+            put32(r.bottom);
+        }
+
+        void putCycle(const DutyCycle& c)
+        {
+            put32(c.onCount);
+            put32(c.offCount);
+        }
+
+        string& buffer()
+        {
+            return mBuf;
+        }
+
+    private:
+        string mBuf;
+};
+
+class CacheReader {
+    public:
+        CacheReader(const char *p, size_t size) : mP(p), mEnd(p + size), mOk(true) {}
+
+        uint32_t get32()
+        {
+            uint32_t v = 0;
+            take(&v, sizeof(v));
+            return v;
+        }
+
+        uint64_t get64()
+        {
+            uint64_t v = 0;
+            take(&v, sizeof(v));
+            return v;
+        }
+
+        string getString()
+        {
+            uint32_t len = get32();
+            if (!mOk || len > (size_t)(mEnd - mP)) {
+                mOk = false;
+                return string();
+            }
+            string s(mP, len);
+            mP += len;
+            return s;
+        }
+
+        Rect getRect()
+        {
+            int l = get32(), t = get32(), r = get32(), b = get32();
+            return Rect(l, t, r, b);
+        }
+
+        DutyCycle getCycle()
+        {
+            DutyCycle c;
+            c.onCount = get32();
+            c.offCount = get32();
+            return c;
+        }
+
+        bool ok() const
+        {
+            return mOk;
+        }
+
+        void fail()
+        {
+            mOk = false;
+        }
+
+    private:
+        void take(void *v, size_t len)
+        {
+            if (!mOk || len > (size_t)(mEnd - mP)) {
+                mOk = false;
+                return;
+            }
+            memcpy(v, mP, len);
+            mP += len;
+        }
+
+        const char *mP;
+        const char *mEnd;
+        bool mOk;
+};
+
+static void putSpec(CacheWriter& w, const sp<SurfaceSpec>& s)
+{
+    const UpdateParams& u = s->updateParams;
+
+    w.putString(s->name);
+    w.put32(s->renderFlags);
+    w.put32(s->format);
+    w.put32(s->bufferFormat);
+    w.put32(s->zOrder);
+    w.put32(s->transform);
+    w.put32(s->srcGeometry.width);
+    w.put32(s->srcGeometry.height);
+    w.put32(s->srcGeometry.stride);
+    w.putRect(s->srcGeometry.crop);
+    w.putRect(s->outRect);
+    w.put32(s->transparentRegionHint.size());
+    for (List<Rect>::iterator it = s->transparentRegionHint.begin();
+            it != s->transparentRegionHint.end(); ++it)
+        w.putRect(*it);
+    w.put32(s->contentType);
+    w.putString(s->content);
+    w.put64(u.iterations);
+    w.put32(u.latency);
+    w.put32(u.latencyPhase);
+    w.putCycle(u.contentUpdateCycle);
+    w.putCycle(u.showCycle);
+    w.putCycle(u.positionCycle);
+    w.putCycle(u.sizeCycle);
+    w.putRect(u.outRectStep);
+    w.putRect(u.outRectLimit);
+    w.put32(s->flags);
+    w.put32(s->bufferCount);
+    w.put32(s->pipelineDepth);
+    w.put32(s->prefault);
+    w.put32(s->readAhead);
+    w.put32(s->verify);
+    w.putString(s->verifyManifest);
+    w.putString(s->capture);
+    w.put32(s->captureFrames);
+    w.put64(s->sched.cpuMask);
+    w.put32(s->sched.policy);
+    w.put32(s->sched.priority);
+    w.put32(s->sched.nice);
+    w.put32(s->sched.uclampMin);
+    w.put32(s->sched.uclampMax);
+    w.putString(s->sched.cgroup);
+    w.putString(s->glGroup);
+    w.put32(s->startDelay);
+    w.put32(s->stopTime);
+    w.put32(s->phases.size());
+    for (List<Phase>::iterator it = s->phases.begin(); it != s->phases.end(); ++it) {
+        w.put32(it->time);
+        w.put32(it->fields);
+        w.put32(it->latency);
+        w.putCycle(it->contentUpdateCycle);
+        w.putCycle(it->showCycle);
+        w.putCycle(it->positionCycle);
+        w.putCycle(it->sizeCycle);
+    }
+    w.put32(s->keyframes.size());
+    for (List<Keyframe>::iterator it = s->keyframes.begin(); it != s->keyframes.end(); ++it) {
+        w.put32(it->track);
+        w.put32(it->time);
+        w.put32(it->a);
+        w.put32(it->b);
+        w.put32(it->easing);
+    }
+    w.put32(s->keyframeLoop);
+}
+
+static sp<SurfaceSpec> getSpec(CacheReader& r)
+{
+    sp<SurfaceSpec> s = new SurfaceSpec();
+    UpdateParams& u = s->updateParams;
+
+    s->name = r.getString();
+    s->renderFlags = r.get32();
+    s->format = r.get32();
+    s->bufferFormat = r.get32();
+    s->zOrder = r.get32();
+    s->transform = r.get32();
+    s->srcGeometry.width = r.get32();
+    s->srcGeometry.height = r.get32();
+    s->srcGeometry.stride = r.get32();
+    s->srcGeometry.crop = r.getRect();
+    s->outRect = r.getRect();
+    uint32_t hints = r.get32();
+    for (uint32_t i = 0; i < hints && r.ok(); i++)
+        s->transparentRegionHint.push_back(r.getRect());
+    s->contentType = (ContentType::Enum)r.get32();
+    s->content = r.getString();
+    u.iterations = r.get64();
+    u.latency = r.get32();
+    u.latencyPhase = r.get32();
+    u.contentUpdateCycle = r.getCycle();
+    u.showCycle = r.getCycle();
+    u.positionCycle = r.getCycle();
+    u.sizeCycle = r.getCycle();
+    u.outRectStep = r.getRect();
+    u.outRectLimit = r.getRect();
+    s->flags = r.get32();
+    s->bufferCount = r.get32();
+    s->pipelineDepth = r.get32();
+    s->prefault = r.get32();
+    s->readAhead = r.get32();
+    s->verify = r.get32() != 0;
+    s->verifyManifest = r.getString();
+    s->capture = r.getString();
+    s->captureFrames = r.get32();
+    s->sched.cpuMask = r.get64();
+    s->sched.policy = r.get32();
+    s->sched.priority = r.get32();
+    s->sched.nice = r.get32();
+    s->sched.uclampMin = r.get32();
+    s->sched.uclampMax = r.get32();
+    s->sched.cgroup = r.getString();
+    s->glGroup = r.getString();
+    s->startDelay = r.get32();
+    s->stopTime = r.get32();
+    uint32_t phases = r.get32();
+    for (uint32_t i = 0; i < phases && r.ok(); i++) {
+        Phase ph;
+        ph.time = r.get32();
+        ph.fields = r.get32();
+        ph.latency = r.get32();
+        ph.contentUpdateCycle = r.getCycle();
+        ph.showCycle = r.getCycle();
+        ph.positionCycle = r.getCycle();
+        ph.sizeCycle = r.getCycle();
+        s->phases.push_back(ph);
+    }
+    uint32_t keyframes = r.get32();
+    for (uint32_t i = 0; i < keyframes && r.ok(); i++) {
+        Keyframe kf;
+        kf.track = (Keyframe::Track)r.get32();
+        kf.time = r.get32();
+        kf.a = r.get32();
+        kf.b = r.get32();
+        kf.easing = (Keyframe::Easing)r.get32();
+        if (kf.track >= Keyframe::TRACK_MAX) {
+            r.fail();
+            break;
+        }
+        s->keyframes.push_back(kf);
+    }
+    s->keyframeLoop = r.get32() != 0;
+
+    return s;
+}
+
+// Map a whole file read only. An empty file maps to NULL.
+static bool mapFile(const string& path, void*& data, size_t& size)
+{
+    data = NULL;
+    size = 0;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = data != MAP_FAILED;
+        if (ok)
+            size = st.st_size;
+        else
+            data = NULL;
+    }
+    close(fd);
+    return ok;
+}
+
+// FNV-1a 64
+static uint64_t hashData(const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool SpecCache::load(string dir, string filename, List<sp<SurfaceSpec> >& specs)
+{
+    nsecs_t start = systemTime();
+
+    void *data;
+    size_t size;
+    if (!mapFile(filename, data, size))
+        return SpecParser::parseFile(filename, specs); // Reports the error
+
+    uint64_t hash = hashData(data, size);
+    if (data != NULL)
+        munmap(data, size);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.spec", (unsigned long long)hash);
+    string path = dir + name;
+
+    List<sp<SurfaceSpec> > parsed;
+    if (read(path, hash, size, parsed)) {
+        LOGI("%s: %d surfaces from cache in %lld us", filename.c_str(), (int)parsed.size(),
+                (long long)ns2us(systemTime() - start));
+    } else {
+        if (!SpecParser::parseFile(filename, parsed))
+            return false;
+        mkdir(dir.c_str(), 0775); // Fine if it exists
+        write(path, hash, size, parsed);
+        LOGI("%s: %d surfaces parsed in %lld us", filename.c_str(), (int)parsed.size(),
+                (long long)ns2us(systemTime() - start));
+    }
+
+    for (List<sp<SurfaceSpec> >::iterator it = parsed.begin(); it != parsed.end(); ++it)
+        specs.push_back(*it);
+    return true;
+}
+
+bool SpecCache::read(string path, uint64_t hash, uint64_t size,
+        List<sp<SurfaceSpec> >& specs)
+{
+    void *map;
+    size_t len;
+    if (!mapFile(path, map, len) || map == NULL)
+        return false;
+    const char *data = (const char*)map;
+
+    CacheHeader h;
+    bool ok = len >= sizeof(h);
+    if (ok) {
+        memcpy(&h, data, sizeof(h));
+        ok = h.magic == CACHE_MAGIC && h.version == CACHE_VERSION &&
+            h.sourceHash == hash && h.sourceSize == size && h.size == len;
+    }
+
+    if (ok) {
+        CacheReader r(data + sizeof(h), len - sizeof(h));
+        for (uint32_t i = 0; i < h.count && r.ok(); i++)
+            specs.push_back(getSpec(r));
+        ok = r.ok();
+    }
+
+    munmap(map, len);
+
+    if (!ok) {
+        LOGW("ignoring stale or invalid spec cache '%s'", path.c_str());
+        specs.clear();
+    }
+    return ok;
+}
+
+bool SpecCache::write(string path, uint64_t hash, uint64_t size,
+        List<sp<SurfaceSpec> >& specs)
+{
+    CacheWriter w;
+    for (List<sp<SurfaceSpec> >::iterator it = specs.begin(); it != specs.end(); ++it)
+        putSpec(w, *it);
+
+    CacheHeader h;
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.sourceHash = hash;
+    h.sourceSize = size;
+    h.count = specs.size();
+    h.size = sizeof(h) + w.buffer().size();
+
+    // Write aside and rename, concurrent runs may share the cache
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%d", (int)getpid());
+    string tmp = path + suffix;
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOGW("unable to write spec cache '%s': %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool ok = ::write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+        ::write(fd, w.buffer().data(), w.buffer().size()) == (ssize_t)w.buffer().size();
+    close(fd);
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOGW("unable to write spec cache '%s': %s", path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    LOGD("wrote spec cache '%s', %d surfaces", path.c_str(), (int)specs.size());
+    return true;
+}
@@ -35,347 +35,1128 @@
 #include <ui/PixelFormat.h>
 #include <utils/Log.h>
 
-#include <fstream>
-#include <iostream>
-#include <sstream>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "SpecParser.h"
 
 using namespace android;
 using namespace std;
 
-inline void trim(string& str)
+// Non-owning view of part of the mapped case file, the platform stlport has
+// no string_view. Lines and words are handed around as tokens so a case file
+// is parsed without copying it.
+struct Token {
+    const char *p;
+    size_t len;
+
+    Token() : p(NULL), len(0) {}
+    Token(const char *s, size_t l) : p(s), len(l) {}
+    Token(const string& s) : p(s.data()), len(s.size()) {}
+
+    bool empty() const
+    {
+        return len == 0;
+    }
+
+    bool operator==(const char *s) const
+    {
+        size_t l = strlen(s);
+        return l == len && memcmp(p, s, l) == 0;
+    }
+
+    string str() const
+    {
+        return string(p, len);
+    }
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline Token trim(Token t)
+{
+    while (t.len > 0 && isSpace(t.p[0])) {
+        t.p++;
+        t.len--;
+    }
+    while (t.len > 0 && isSpace(t.p[t.len - 1]))
+        t.len--;
+    return t;
+}
+
+// Split the first whitespace separated word off rest
+inline Token nextWord(Token& rest)
+{
+    rest = trim(rest);
+
+    size_t i = 0;
+    while (i < rest.len && !isSpace(rest.p[i]))
+        i++;
+
+    Token word(rest.p, i);
+    rest.p += i;
+    rest.len -= i;
+    return word;
+}
+
+// Decimal, or hex with a 0x prefix. The whole token must be a number.
+static bool toLong(Token t, long& v)
+{
+    const char *p = t.p, *end = t.p + t.len;
+    bool negative = false;
+    int base = 10;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    if (p == end)
+        return false;
+
+    unsigned long r = 0;
+    for (; p < end; p++) {
+        int d;
+        if (*p >= '0' && *p <= '9')
+            d = *p - '0';
+        else if (base == 16 && *p >= 'a' && *p <= 'f')
+            d = *p - 'a' + 10;
+        else if (base == 16 && *p >= 'A' && *p <= 'F')
+            d = *p - 'A' + 10;
+        else
+            return false;
+        r = r * base + d;
+    }
+
+    v = negative ? -(long)r : (long)r;
+    return true;
+}
+
+template<typename T>
+inline bool nextNumber(Token& rest, T& out)
 {
-    str.erase(0, str.find_first_not_of(' '));
-    str.erase(str.find_last_not_of(' ') + 1);
+    long v;
+    if (!toLong(nextWord(rest), v))
+        return false;
+    out = (T)v;
+    return true;
 }
 
-inline Rect parseRect(stringstream& ss, string filename, unsigned int n,
-        string prop, bool warnWH)
+enum KeywordKind {
+    PROPERTY,
+    PIXEL_FORMAT,
+    TRANSFORM,
+    RENDER_FLAG,
+    CONTENT_TYPE,
+    KEYFRAME_TRACK,
+    KEYFRAME_EASING,
+    PREFAULT_FLAG,
+    SCHED_POLICY,
+};
+
+enum Property {
+    P_SURFACE,
+    P_NAME,
+    P_RENDER_FLAGS,
+    P_FORMAT,
+    P_BUFFER_FORMAT,
+    P_ZORDER,
+    P_TRANSFORM,
+    P_WIDTH,
+    P_HEIGHT,
+    P_STRIDE,
+    P_CROP,
+    P_OUTPUT,
+    P_TRANSPARENT_HINT,
+    P_CONTENTTYPE,
+    P_CONTENT,
+    P_UPDATE_ITERATIONS,
+    P_UPDATE_LATENCY,
+    P_UPDATE_LATENCY_PHASE,
+    P_UPDATE_OUTPUT_STEP,
+    P_UPDATE_OUTPUT_LIMIT,
+    P_UPDATE_CONTENT,
+    P_UPDATE_CONTENT_SHOW,
+    P_UPDATE_CONTENT_POSITION,
+    P_UPDATE_CONTENT_SIZE,
+    P_FLAGS,
+    P_BUFFER_COUNT,
+    P_PIPELINE_DEPTH,
+    P_PREFAULT,
+    P_READ_AHEAD,
+    P_VERIFY,
+    P_VERIFY_MANIFEST,
+    P_CAPTURE,
+    P_CPU_AFFINITY,
+    P_SCHED_POLICY,
+    P_NICE,
+    P_UCLAMP,
+    P_CGROUP,
+    P_GL_GROUP,
+    P_START_DELAY,
+    P_STOP_TIME,
+    P_PHASE,
+    P_END_PHASE,
+    P_KEYFRAME,
+    P_KEYFRAME_LOOP,
+    P_REPEAT,
+    P_END,
+
+    // Deprecated
+    P_UPDATE_CONTENT_ON,
+    P_UPDATE_CONTENT_OFF,
+    P_UPDATE_CONTENT_SHOW_ON,
+    P_UPDATE_CONTENT_SHOW_OFF,
+};
+
+struct Keyword {
+    const char *name;
+    KeywordKind kind;
+    int value;
+};
+
+static const Keyword sKeywords[] = {
+    { "surface", PROPERTY, P_SURFACE },
+    { "name", PROPERTY, P_NAME },
+    { "render_flags", PROPERTY, P_RENDER_FLAGS },
+    { "format", PROPERTY, P_FORMAT },
+    { "buffer_format", PROPERTY, P_BUFFER_FORMAT },
+    { "zorder", PROPERTY, P_ZORDER },
+    { "transform", PROPERTY, P_TRANSFORM },
+    { "width", PROPERTY, P_WIDTH },
+    { "height", PROPERTY, P_HEIGHT },
+    { "stride", PROPERTY, P_STRIDE },
+    { "crop", PROPERTY, P_CROP },
+    { "output", PROPERTY, P_OUTPUT },
+    { "transparent_hint", PROPERTY, P_TRANSPARENT_HINT },
+    { "contenttype", PROPERTY, P_CONTENTTYPE },
+    { "content", PROPERTY, P_CONTENT },
+    { "update_iterations", PROPERTY, P_UPDATE_ITERATIONS },
+    { "update_latency", PROPERTY, P_UPDATE_LATENCY },
+    { "update_latency_phase", PROPERTY, P_UPDATE_LATENCY_PHASE },
+    { "update_output_step", PROPERTY, P_UPDATE_OUTPUT_STEP },
+    { "update_output_limit", PROPERTY, P_UPDATE_OUTPUT_LIMIT },
+    { "update_content", PROPERTY, P_UPDATE_CONTENT },
+    { "update_content_show", PROPERTY, P_UPDATE_CONTENT_SHOW },
+    { "update_content_position", PROPERTY, P_UPDATE_CONTENT_POSITION },
+    { "update_content_size", PROPERTY, P_UPDATE_CONTENT_SIZE },
+    { "flags", PROPERTY, P_FLAGS },
+    { "buffer_count", PROPERTY, P_BUFFER_COUNT },
+    { "pipeline_depth", PROPERTY, P_PIPELINE_DEPTH },
+    { "prefault", PROPERTY, P_PREFAULT },
+    { "read_ahead", PROPERTY, P_READ_AHEAD },
+    { "verify", PROPERTY, P_VERIFY },
+    { "verify_manifest", PROPERTY, P_VERIFY_MANIFEST },
+    { "capture", PROPERTY, P_CAPTURE },
+    { "cpu_affinity", PROPERTY, P_CPU_AFFINITY },
+    { "sched_policy", PROPERTY, P_SCHED_POLICY },
+    { "nice", PROPERTY, P_NICE },
+    { "uclamp", PROPERTY, P_UCLAMP },
+    { "cgroup", PROPERTY, P_CGROUP },
+    { "gl_group", PROPERTY, P_GL_GROUP },
+    { "start_delay", PROPERTY, P_START_DELAY },
+    { "stop_time", PROPERTY, P_STOP_TIME },
+    { "phase", PROPERTY, P_PHASE },
+    { "end_phase", PROPERTY, P_END_PHASE },
+    { "keyframe", PROPERTY, P_KEYFRAME },
+    { "keyframe_loop", PROPERTY, P_KEYFRAME_LOOP },
+    { "repeat", PROPERTY, P_REPEAT },
+    { "end", PROPERTY, P_END },
+    { "update_content_on", PROPERTY, P_UPDATE_CONTENT_ON },
+    { "update_content_off", PROPERTY, P_UPDATE_CONTENT_OFF },
+    { "update_content_show_on", PROPERTY, P_UPDATE_CONTENT_SHOW_ON },
+    { "update_content_show_off", PROPERTY, P_UPDATE_CONTENT_SHOW_OFF },
+
+    { "PIXEL_FORMAT_UNKNOWN", PIXEL_FORMAT, PIXEL_FORMAT_UNKNOWN },
+    { "PIXEL_FORMAT_NONE", PIXEL_FORMAT, PIXEL_FORMAT_NONE },
+    { "PIXEL_FORMAT_CUSTOM", PIXEL_FORMAT, PIXEL_FORMAT_CUSTOM },
+    { "PIXEL_FORMAT_TRANSLUCENT", PIXEL_FORMAT, PIXEL_FORMAT_TRANSLUCENT },
+    { "PIXEL_FORMAT_TRANSPARENT", PIXEL_FORMAT, PIXEL_FORMAT_TRANSPARENT },
+    { "PIXEL_FORMAT_OPAQUE", PIXEL_FORMAT, PIXEL_FORMAT_OPAQUE },
+    { "PIXEL_FORMAT_RGBA_8888", PIXEL_FORMAT, PIXEL_FORMAT_RGBA_8888 },
+    { "PIXEL_FORMAT_RGBX_8888", PIXEL_FORMAT, PIXEL_FORMAT_RGBX_8888 },
+    { "PIXEL_FORMAT_RGB_888", PIXEL_FORMAT, PIXEL_FORMAT_RGB_888 },
+    { "PIXEL_FORMAT_RGB_565", PIXEL_FORMAT, PIXEL_FORMAT_RGB_565 },
+    { "PIXEL_FORMAT_BGRA_8888", PIXEL_FORMAT, PIXEL_FORMAT_BGRA_8888 },
+    { "PIXEL_FORMAT_RGBA_5551", PIXEL_FORMAT, PIXEL_FORMAT_RGBA_5551 },
+    { "PIXEL_FORMAT_RGBA_4444", PIXEL_FORMAT, PIXEL_FORMAT_RGBA_4444 },
+    { "PIXEL_FORMAT_A_8", PIXEL_FORMAT, PIXEL_FORMAT_A_8 },
+#ifdef ADTF_ICS_AND_EARLIER
+    { "PIXEL_FORMAT_L_8", PIXEL_FORMAT, PIXEL_FORMAT_L_8 },
+    { "PIXEL_FORMAT_LA_88", PIXEL_FORMAT, PIXEL_FORMAT_LA_88 },
+    { "PIXEL_FORMAT_RGB_332", PIXEL_FORMAT, PIXEL_FORMAT_RGB_332 },
+#endif
+    { "HAL_PIXEL_FORMAT_TI_NV12", PIXEL_FORMAT, HAL_PIXEL_FORMAT_TI_NV12 },
+    { "HAL_PIXEL_FORMAT_TI_BGRX", PIXEL_FORMAT, HAL_PIXEL_FORMAT_TI_BGRX },
+
+    { "NATIVE_WINDOW_TRANSFORM_FLIP_H", TRANSFORM, HAL_TRANSFORM_FLIP_H },
+    { "HAL_TRANSFORM_FLIP_H", TRANSFORM, HAL_TRANSFORM_FLIP_H },
+    { "NATIVE_WINDOW_TRANSFORM_FLIP_V", TRANSFORM, HAL_TRANSFORM_FLIP_V },
+    { "HAL_TRANSFORM_FLIP_V", TRANSFORM, HAL_TRANSFORM_FLIP_V },
+    { "NATIVE_WINDOW_TRANSFORM_ROT_90", TRANSFORM, HAL_TRANSFORM_ROT_90 },
+    { "HAL_TRANSFORM_ROT_90", TRANSFORM, HAL_TRANSFORM_ROT_90 },
+    { "NATIVE_WINDOW_TRANSFORM_ROT_180", TRANSFORM, HAL_TRANSFORM_ROT_180 },
+    { "HAL_TRANSFORM_ROT_180", TRANSFORM, HAL_TRANSFORM_ROT_180 },
+    { "NATIVE_WINDOW_TRANSFORM_ROT_270", TRANSFORM, HAL_TRANSFORM_ROT_270 },
+    { "HAL_TRANSFORM_ROT_270", TRANSFORM, HAL_TRANSFORM_ROT_270 },
+
+    { "KEEPALIVE", RENDER_FLAG, RenderFlags::KEEPALIVE },
+    { "keepalive", RENDER_FLAG, RenderFlags::KEEPALIVE },
+    { "GL", RENDER_FLAG, RenderFlags::GL },
+    { "gl", RENDER_FLAG, RenderFlags::GL },
+    { "ASYNC", RENDER_FLAG, RenderFlags::ASYNC },
+    { "async", RENDER_FLAG, RenderFlags::ASYNC },
+    { "SILENT", RENDER_FLAG, RenderFlags::SILENT },
+    { "silent", RENDER_FLAG, RenderFlags::SILENT },
+    { "VSYNC", RENDER_FLAG, RenderFlags::VSYNC },
+    { "vsync", RENDER_FLAG, RenderFlags::VSYNC },
+    { "PERF", RENDER_FLAG, RenderFlags::PERF },
+    { "perf", RENDER_FLAG, RenderFlags::PERF },
+    { "GLES2", RENDER_FLAG, RenderFlags::GLES2 },
+    { "gles2", RENDER_FLAG, RenderFlags::GLES2 },
+
+    { "solid", CONTENT_TYPE, ContentType::SOLID },
+    { "SOLID", CONTENT_TYPE, ContentType::SOLID },
+    { "file", CONTENT_TYPE, ContentType::FILE },
+    { "FILE", CONTENT_TYPE, ContentType::FILE },
+    { "plugin", CONTENT_TYPE, ContentType::PLUGIN },
+    { "PLUGIN", CONTENT_TYPE, ContentType::PLUGIN },
+
+    { "position", KEYFRAME_TRACK, Keyframe::POSITION },
+    { "size", KEYFRAME_TRACK, Keyframe::SIZE },
+    { "alpha", KEYFRAME_TRACK, Keyframe::ALPHA },
+    { "linear", KEYFRAME_EASING, Keyframe::LINEAR },
+    { "ease", KEYFRAME_EASING, Keyframe::EASE },
+
+    { "populate", PREFAULT_FLAG, Prefault::POPULATE },
+    { "mlock", PREFAULT_FLAG, Prefault::MLOCK },
+    { "hugepage", PREFAULT_FLAG, Prefault::HUGEPAGE },
+
+    { "other", SCHED_POLICY, SCHED_OTHER },
+    { "fifo", SCHED_POLICY, SCHED_FIFO },
+    { "rr", SCHED_POLICY, SCHED_RR },
+    { "batch", SCHED_POLICY, SCHED_BATCH },
+};
+
+#define KEYWORD_COUNT (sizeof(sKeywords) / sizeof(sKeywords[0]))
+
+// Table size, a power of two well above KEYWORD_COUNT so that a collision
+// free seed turns up after a handful of tries
+#define KEYWORD_SLOTS 2048
+
+// Perfect hash over sKeywords. The seed is searched once at startup, so new
+// keywords only need to be added to the list above. A lookup is one hash of
+// the word and at most one compare.
+class KeywordTable {
+    public:
+        KeywordTable() : mSeed(0)
+        {
+            for (uint32_t seed = 1; seed < 0x10000; seed++) {
+                if (build(seed)) {
+                    mSeed = seed;
+                    return;
+                }
+            }
+            LOGE("no collision free seed for %d keywords", (int)KEYWORD_COUNT);
+        }
+
+        const Keyword* find(Token t, KeywordKind kind) const
+        {
+            uint16_t i = mSlots[hash(t.p, t.len, mSeed)];
+            if (i == 0)
+                return NULL;
+
+            const Keyword *k = &sKeywords[i - 1];
+            if (k->kind != kind || !(t == k->name))
+                return NULL;
+            return k;
+        }
+
+    private:
+        // FNV-1a, seed folded into the offset basis
+        static uint32_t hash(const char *p, size_t len, uint32_t seed)
+        {
+            uint32_t h = 2166136261u ^ seed;
+            for (size_t i = 0; i < len; i++) {
+                h ^= (uint8_t)p[i];
+                h *= 16777619u;
+            }
+            return h & (KEYWORD_SLOTS - 1);
+        }
+
+        bool build(uint32_t seed)
+        {
+            memset(mSlots, 0, sizeof(mSlots));
+            for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+                uint32_t h = hash(sKeywords[i].name, strlen(sKeywords[i].name), seed);
+                if (mSlots[h] != 0)
+                    return false;
+                mSlots[h] = i + 1;
+            }
+            return true;
+        }
+
+        uint32_t mSeed;
+        // Index + 1 into sKeywords, 0 if free. Wide enough for any count
+        // that fits the table.
+        uint16_t mSlots[KEYWORD_SLOTS];
+};
+
+static const KeywordTable sKeywordTable;
+
+inline Rect parseRect(Token& rest, const string& filename, unsigned int n,
+        const char *prop, bool warnWH)
 {
     int x, y, w, h;
 
-    ss >> x >> y;
-    if (!ss.fail()) {
-        ss >> w >> h;
-        if (ss.fail()) {
+    if (nextNumber(rest, x) && nextNumber(rest, y)) {
+        if (!nextNumber(rest, w) || !nextNumber(rest, h)) {
             if (warnWH)
-                LOGW("%s:%u invalid w and/or h in %s, defaulting to 0", filename.c_str(), n, prop.c_str());
+                LOGW("%s:%u invalid w and/or h in %s, defaulting to 0", filename.c_str(), n, prop);
             w = h = 0;
         }
     } else {
-        LOGW("%s:%u invalid x and/or y in %s, defaulting to 0", filename.c_str(), n, prop.c_str());
-        x = y = 0;
+        LOGW("%s:%u invalid x and/or y in %s, defaulting to 0", filename.c_str(), n, prop);
+        x = y = w = h = 0;
     }
 
     return Rect(x, y, x + w, y + h);
 }
 
-inline bool parseBool(stringstream& ss, string line, string filename, unsigned int n,
-        string prop)
+// Integer, or one of the names of kind. Unknown names log a warning and
+// give 0.
+static int parseValue(Token word, KeywordKind kind, const string& filename,
+        unsigned int n, const char *prop)
 {
-    int b = 0;
-    ss >> b;
-    if (ss.fail()) {
-        string v;
-        ss.clear();
-        ss.str(line);
-        ss >> prop >> v;
-        if (v == "true")
-            return true;
-        else if (v == "false")
-            return false;
-        else {
-            LOGW("%s:%u unknown %s '%s'", filename.c_str(), n, prop.c_str(), v.c_str());
-            return false;
-        }
-    } else
-        return (b == 1);
-}
+    long v;
+    if (toLong(word, v))
+        return (int)v;
 
-inline PixelFormat parsePixelFormat(stringstream& ss, string line, string filename,
-        unsigned int n, string prop)
-{
-    PixelFormat f = 0;
-
-    // If format is given as an int cast to PixelFormat, otherwise translate
-    ss >> f;
-    if (ss.fail()) {
-        // Try to translate string since it wasn't an int
-        string pf;
-        ss.clear();
-        ss.str(line);
-        ss >> prop >> pf;
-
-        if (pf == "PIXEL_FORMAT_UNKNOWN")
-            f = PIXEL_FORMAT_UNKNOWN;
-        else if (pf == "PIXEL_FORMAT_NONE")
-            f = PIXEL_FORMAT_NONE;
-        else if (pf == "PIXEL_FORMAT_CUSTOM")
-            f = PIXEL_FORMAT_CUSTOM;
-        else if (pf == "PIXEL_FORMAT_TRANSLUCENT")
-            f = PIXEL_FORMAT_TRANSLUCENT;
-        else if (pf == "PIXEL_FORMAT_TRANSPARENT")
-            f = PIXEL_FORMAT_TRANSPARENT;
-        else if (pf == "PIXEL_FORMAT_OPAQUE")
-            f = PIXEL_FORMAT_OPAQUE;
-        else if (pf == "PIXEL_FORMAT_RGBA_8888")
-            f = PIXEL_FORMAT_RGBA_8888;
-        else if (pf == "PIXEL_FORMAT_RGBX_8888")
-            f = PIXEL_FORMAT_RGBX_8888;
-        else if (pf == "PIXEL_FORMAT_RGB_888")
-            f = PIXEL_FORMAT_RGB_888;
-        else if (pf == "PIXEL_FORMAT_RGB_565")
-            f = PIXEL_FORMAT_RGB_565;
-        else if (pf == "PIXEL_FORMAT_BGRA_8888")
-            f = PIXEL_FORMAT_BGRA_8888;
-        else if (pf == "PIXEL_FORMAT_RGBA_5551")
-            f = PIXEL_FORMAT_RGBA_5551;
-        else if (pf == "PIXEL_FORMAT_RGBA_4444")
-            f = PIXEL_FORMAT_RGBA_4444;
-        else if (pf == "PIXEL_FORMAT_A_8")
-            f = PIXEL_FORMAT_A_8;
-#ifdef ADTF_ICS_AND_EARLIER
-        else if (pf == "PIXEL_FORMAT_L_8")
-            f = PIXEL_FORMAT_L_8;
-        else if (pf == "PIXEL_FORMAT_LA_88")
-            f = PIXEL_FORMAT_LA_88;
-        else if (pf == "PIXEL_FORMAT_RGB_332")
-            f = PIXEL_FORMAT_RGB_332;
-#endif
-        else if (pf == "HAL_PIXEL_FORMAT_TI_NV12")
-            f = HAL_PIXEL_FORMAT_TI_NV12;
-        else if (pf == "HAL_PIXEL_FORMAT_TI_BGRX")
-            f = HAL_PIXEL_FORMAT_TI_BGRX;
-        else
-            LOGW("%s:%u unknown %s '%s'", filename.c_str(), n, prop.c_str(), pf.c_str());
+    const Keyword *k = sKeywordTable.find(word, kind);
+    if (k == NULL) {
+        LOGW("%s:%u unknown %s '%.*s'", filename.c_str(), n, prop, (int)word.len, word.p);
+        return 0;
     }
-    return f;
+    return k->value;
 }
 
-inline int parseRenderFlags(stringstream& ss, string line, string filename,
-        unsigned int n, string prop)
+// Values of all remaining words OR'ed together
+static int parseMask(Token& rest, KeywordKind kind, const string& filename,
+        unsigned int n, const char *prop)
 {
-    int f = 0, v = 0;
-    string sv;
-    stringstream ssv(stringstream::in | stringstream::out);
-
-    while (ss >> sv) {
-        v = 0;
-        ssv.clear();
-        ssv.str(sv);
-
-        ssv >> v;
-        if (ssv.fail()) {
-            if (sv == "KEEPALIVE" || sv == "keepalive")
-                v = RenderFlags::KEEPALIVE;
-            else if (sv == "GL" || sv == "gl")
-                v = RenderFlags::GL;
-            else if (sv == "ASYNC" || sv == "async")
-                v = RenderFlags::ASYNC;
-            else if (sv == "SILENT" || sv == "silent")
-                v = RenderFlags::SILENT;
-            else if (sv == "VSYNC" || sv == "vsync")
-                v = RenderFlags::VSYNC;
-            else
-                LOGW("%s:%u unknown %s '%s'", filename.c_str(), n, prop.c_str(), sv.c_str());
-        }
+    int mask = 0;
 
-        f |= v;
-        sv.clear();
-    }
-    return f;
+    for (Token word = nextWord(rest); !word.empty(); word = nextWord(rest))
+        mask |= parseValue(word, kind, filename, n, prop);
+    return mask;
 }
 
-inline int parseTransform(stringstream& ss, string line, string filename,
-        unsigned int n, string prop)
+// A hex mask, e.g. 0xf0, or a list of CPUs and ranges, e.g. 4-7,0
+static bool parseCpus(Token word, uint64_t& mask)
 {
-    int t = 0, v = 0;
-    string sv;
-    stringstream ssv(stringstream::in | stringstream::out);
-
-    while (ss >> sv) {
-        v = 0;
-        ssv.clear();
-        ssv.str(sv);
-
-        ssv >> v;
-        if (ssv.fail()) {
-            if (sv == "NATIVE_WINDOW_TRANSFORM_FLIP_H" || sv == "HAL_TRANSFORM_FLIP_H")
-                v = HAL_TRANSFORM_FLIP_H;
-            else if (sv == "NATIVE_WINDOW_TRANSFORM_FLIP_V" || sv == "HAL_TRANSFORM_FLIP_V")
-                v = HAL_TRANSFORM_FLIP_V;
-            else if (sv == "NATIVE_WINDOW_TRANSFORM_ROT_90" || sv == "HAL_TRANSFORM_ROT_90")
-                v = HAL_TRANSFORM_ROT_90;
-            else if (sv == "NATIVE_WINDOW_TRANSFORM_ROT_180" || sv == "HAL_TRANSFORM_ROT_180")
-                v = HAL_TRANSFORM_ROT_180;
-            else if (sv == "NATIVE_WINDOW_TRANSFORM_ROT_270" || sv == "HAL_TRANSFORM_ROT_270")
-                v = HAL_TRANSFORM_ROT_270;
-            else
-                LOGW("%s:%u unknown %s '%s'", filename.c_str(), n, prop.c_str(), sv.c_str());
-        }
+    long v;
 
-        t |= v;
-        sv.clear();
+    if (word.len > 2 && word.p[0] == '0' && (word.p[1] == 'x' || word.p[1] == 'X')) {
+        if (!toLong(word, v))
+            return false;
+        mask = (unsigned long)v;
+        return mask != 0;
     }
-    return t;
+
+    mask = 0;
+    const char *p = word.p, *end = word.p + word.len;
+    while (p < end) {
+        const char *comma = (const char*)memchr(p, ',', end - p);
+        if (comma == NULL)
+            comma = end;
+        const char *dash = (const char*)memchr(p, '-', comma - p);
+
+        long first, last;
+        if (!toLong(Token(p, (dash != NULL ? dash : comma) - p), first))
+            return false;
+        last = first;
+        if (dash != NULL && !toLong(Token(dash + 1, comma - dash - 1), last))
+            return false;
+        if (first < 0 || last < first || last >= 64)
+            return false;
+
+        for (long c = first; c <= last; c++)
+            mask |= 1ULL << c;
+        p = comma + 1;
+    }
+    return mask != 0;
 }
 
-bool SpecParser::parseFile(string filename, List<sp<SurfaceSpec> >& specs)
+inline PixelFormat parsePixelFormat(Token& rest, const string& filename,
+        unsigned int n, const char *prop)
 {
-    ifstream f(filename.c_str(), ifstream::in);
-    if (!f) {
-        LOGE("unable to open '%s' for reading", filename.c_str());
-        return false;
-    }
+    return parseValue(nextWord(rest), PIXEL_FORMAT, filename, n, prop);
+}
+
+// Parser position, shared by file lines and repeat expansions
+struct ParseState {
+    ParseState(const string& f, List<sp<SurfaceSpec> >& s)
+        : filename(f), specs(s), inPhase(false), phaseLine(0) {}
 
+    const string& filename;
+    List<sp<SurfaceSpec> >& specs;
     sp<SurfaceSpec> spec;
-    unsigned int n = 0;
 
-    while (f.good()) {
-        string line;
+    // Between 'phase' and 'end_phase', timeline properties go to phase
+    bool inPhase;
+    unsigned int phaseLine;
+    Phase phase;
+};
 
-        getline(f, line);
-        trim(line);
-        n++;
-        if (line.empty() || line.find_first_of('#') == 0)
-            continue;
+static void endPhase(ParseState& st)
+{
+    if (!st.inPhase)
+        return;
+    st.inPhase = false;
 
-        if (spec == 0 && line != "surface") {
-            LOGW("%s:%u ignoring '%s' before first 'surface' keyword", filename.c_str(), n, line.c_str());
-            continue;
+    if (st.phase.fields == 0) {
+        LOGW("%s:%u empty phase ignored", st.filename.c_str(), st.phaseLine);
+        return;
+    }
+    st.spec->phases.push_back(st.phase);
+}
+
+// Parse one trimmed, non-empty, non-comment line into the current spec. A
+// 'surface' line pushes the current spec (if any) to specs and starts a new
+// one.
+static void parseLine(Token line, unsigned int n, ParseState& st)
+{
+    const string& filename = st.filename;
+    sp<SurfaceSpec>& spec = st.spec;
+    Token rest = line;
+    const Keyword *k = sKeywordTable.find(nextWord(rest), PROPERTY);
+
+    if (k != NULL && k->value == P_SURFACE && rest.empty()) {
+        if (st.inPhase) {
+            LOGW("%s:%u phase without end_phase", filename.c_str(), st.phaseLine);
+            endPhase(st);
         }
+        if (spec != 0)
+            st.specs.push_back(spec);
+        spec = sp<SurfaceSpec>(new SurfaceSpec());
+        return;
+    }
 
-        if (line == "surface") {
-            if (spec != 0)
-                specs.push_back(spec);
-            spec = sp<SurfaceSpec>(new SurfaceSpec());
-            continue;
+    if (spec == 0) {
+        LOGW("%s:%u ignoring '%.*s' before first 'surface' keyword", filename.c_str(), n,
+                (int)line.len, line.p);
+        return;
+    }
+
+    if (k == NULL) {
+        LOGW("'%s' ignored line '%.*s'", filename.c_str(), (int)line.len, line.p);
+        return;
+    }
+
+    // Only timeline properties may change within a phase
+    if (st.inPhase) {
+        switch (k->value) {
+            case P_UPDATE_LATENCY:
+            case P_UPDATE_CONTENT:
+            case P_UPDATE_CONTENT_SHOW:
+            case P_UPDATE_CONTENT_POSITION:
+            case P_UPDATE_CONTENT_SIZE:
+            case P_PHASE:
+            case P_END_PHASE:
+                break;
+            default:
+                LOGW("%s:%u %s can't change in a phase, ignored", filename.c_str(), n, k->name);
+                return;
         }
+    }
 
-        string prop;
-        stringstream ss(stringstream::in | stringstream::out);
-        ss.str(line);
-        ss >> prop;
+    const char *prop = k->name;
+    bool ok = true;
 
-        if (prop == "name") {
-            if (line.size() < 5) {
-                LOGW("%s:%u empty %s", filename.c_str(), n, prop.c_str());
-                continue;
+    switch (k->value) {
+        case P_NAME:
+            if (line.len < 5) {
+                LOGW("%s:%u empty %s", filename.c_str(), n, prop);
+                return;
             }
-            spec->name = line.substr(5);
-        } else if (prop == "render_flags") {
-            spec->renderFlags = parseRenderFlags(ss, line, filename, n, prop);
-            continue;
-        } else if (prop == "format") {
-            spec->format = parsePixelFormat(ss, line, filename, n, prop);
+            spec->name = string(line.p + 5, line.len - 5);
+            break;
+        case P_RENDER_FLAGS:
+            spec->renderFlags = parseMask(rest, RENDER_FLAG, filename, n, prop);
+            break;
+        case P_FORMAT:
+            spec->format = parsePixelFormat(rest, filename, n, prop);
             if (spec->bufferFormat == PIXEL_FORMAT_NONE)
                 spec->bufferFormat = spec->format;
-            continue;
-        } else if (prop == "buffer_format") {
-            spec->bufferFormat = parsePixelFormat(ss, line, filename, n, prop);
+            break;
+        case P_BUFFER_FORMAT:
+            spec->bufferFormat = parsePixelFormat(rest, filename, n, prop);
             if (spec->format == PIXEL_FORMAT_NONE)
                 spec->format = spec->bufferFormat;
-            continue;
-        } else if (prop == "zorder") {
-            ss >> spec->zOrder;
-        } else if (prop == "transform") {
-            spec->transform = parseTransform(ss, line, filename, n, prop);
-            continue;
-        } else if (prop == "width") {
-            ss >> spec->srcGeometry.width;
+            break;
+        case P_ZORDER:
+            ok = nextNumber(rest, spec->zOrder);
+            break;
+        case P_TRANSFORM:
+            spec->transform = parseMask(rest, TRANSFORM, filename, n, prop);
+            break;
+        case P_WIDTH:
+            ok = nextNumber(rest, spec->srcGeometry.width);
             if (spec->srcGeometry.width > spec->srcGeometry.stride)
                 spec->srcGeometry.stride = spec->srcGeometry.width;
-        } else if (prop == "height") {
-            ss >> spec->srcGeometry.height;
-        } else if (prop == "stride") {
-            ss >> spec->srcGeometry.stride;
+            break;
+        case P_HEIGHT:
+            ok = nextNumber(rest, spec->srcGeometry.height);
+            break;
+        case P_STRIDE:
+            ok = nextNumber(rest, spec->srcGeometry.stride);
             if (spec->srcGeometry.width > spec->srcGeometry.stride)
                 spec->srcGeometry.width = spec->srcGeometry.stride;
-        } else if (prop == "crop") {
-            spec->srcGeometry.crop = parseRect(ss, filename, n, prop, false);
-            continue;
-        } else if (prop == "output") {
-            spec->outRect = parseRect(ss, filename, n, prop, false);
-            continue;
-        } else if (prop == "transparent_hint") {
-            Rect rect = parseRect(ss, filename, n, prop, false);
-            spec->transparentRegionHint.push_back(rect);
-            continue;
-        } else if (prop == "contenttype") {
-            string t;
-            ss >> t;
-            if (ss.fail()) {
-                LOGW("%s:%u invalid %s", filename.c_str(), n, prop.c_str());
-            } else {
-                if (t == "solid" || t == "SOLID")
-                    spec->contentType = ContentType::SOLID;
-                else if (t == "file" || t == "FILE")
-                    spec->contentType = ContentType::FILE;
-                else if (t == "plugin" || t == "PLUGIN")
-                    spec->contentType = ContentType::PLUGIN;
-                else
-                    LOGW("%s:%u invalid %s", filename.c_str(), n, prop.c_str());
+            break;
+        case P_CROP:
+            spec->srcGeometry.crop = parseRect(rest, filename, n, prop, false);
+            break;
+        case P_OUTPUT:
+            spec->outRect = parseRect(rest, filename, n, prop, false);
+            break;
+        case P_TRANSPARENT_HINT:
+            spec->transparentRegionHint.push_back(parseRect(rest, filename, n, prop, false));
+            break;
+        case P_CONTENTTYPE: {
+            const Keyword *t = sKeywordTable.find(nextWord(rest), CONTENT_TYPE);
+            if (t == NULL)
+                LOGW("%s:%u invalid %s", filename.c_str(), n, prop);
+            else
+                spec->contentType = (ContentType::Enum)t->value;
+            break;
+        }
+        case P_CONTENT:
+            if (line.len < 8) {
+                LOGW("'%s' invalid %s", filename.c_str(), prop);
+                return;
             }
-            continue;
-        } else if (prop == "content") {
-            if (line.size() < 8) {
-                LOGW("'%s' invalid %s", filename.c_str(), prop.c_str());
-                continue;
+            spec->content = string(line.p + 8, line.len - 8);
+            break;
+        case P_UPDATE_ITERATIONS:
+            ok = nextNumber(rest, spec->updateParams.iterations);
+            break;
+        case P_UPDATE_LATENCY:
+            if (st.inPhase) {
+                ok = nextNumber(rest, st.phase.latency);
+                st.phase.fields |= Phase::LATENCY;
+            } else {
+                ok = nextNumber(rest, spec->updateParams.latency);
             }
-            spec->content = line.substr(8);
-        } else if (prop == "update_iterations") {
-            ss >> spec->updateParams.iterations;
-        } else if (prop == "update_latency") {
-            ss >> spec->updateParams.latency;
-        } else if (prop == "update_output_step") {
-            spec->updateParams.outRectStep = parseRect(ss, filename, n, prop, true);
-            continue;
-        } else if (prop == "update_output_limit") {
-            spec->updateParams.outRectLimit = parseRect(ss, filename, n, prop, true);
-        } else if (prop == "update_content" || prop == "update_content_show" ||
-                   prop == "update_content_position" || prop == "update_content_size") {
-            DutyCycle *dc = NULL;
-            if (prop == "update_content")
+            break;
+        case P_UPDATE_LATENCY_PHASE:
+            ok = nextNumber(rest, spec->updateParams.latencyPhase);
+            break;
+        case P_UPDATE_OUTPUT_STEP:
+            spec->updateParams.outRectStep = parseRect(rest, filename, n, prop, true);
+            break;
+        case P_UPDATE_OUTPUT_LIMIT:
+            spec->updateParams.outRectLimit = parseRect(rest, filename, n, prop, true);
+            break;
+        case P_UPDATE_CONTENT:
+        case P_UPDATE_CONTENT_SHOW:
+        case P_UPDATE_CONTENT_POSITION:
+        case P_UPDATE_CONTENT_SIZE: {
+            // The off count defaults to 0, every iteration
+            unsigned int on = 0, off = 0;
+            ok = nextNumber(rest, on);
+            if (ok && !rest.empty())
+                ok = nextNumber(rest, off);
+            if (!ok)
+                break;
+
+            DutyCycle *dc;
+            if (st.inPhase) {
+                if (k->value == P_UPDATE_CONTENT) {
+                    dc = &st.phase.contentUpdateCycle;
+                    st.phase.fields |= Phase::CONTENT;
+                } else if (k->value == P_UPDATE_CONTENT_SHOW) {
+                    dc = &st.phase.showCycle;
+                    st.phase.fields |= Phase::SHOW;
+                } else if (k->value == P_UPDATE_CONTENT_POSITION) {
+                    dc = &st.phase.positionCycle;
+                    st.phase.fields |= Phase::POSITION;
+                } else {
+                    dc = &st.phase.sizeCycle;
+                    st.phase.fields |= Phase::SIZE;
+                }
+            } else if (k->value == P_UPDATE_CONTENT) {
                 dc = &spec->updateParams.contentUpdateCycle;
-            else if (prop == "update_content_show")
+            } else if (k->value == P_UPDATE_CONTENT_SHOW) {
                 dc = &spec->updateParams.showCycle;
-            else if (prop == "update_content_position")
+            } else if (k->value == P_UPDATE_CONTENT_POSITION) {
                 dc = &spec->updateParams.positionCycle;
-            else if (prop == "update_content_size")
+            } else {
                 dc = &spec->updateParams.sizeCycle;
-            else
-                continue; // Shouldn't happen
-            dc->onCount = 1; dc->offCount = 0; // Default to every iteration
-            ss >> dc->onCount >> dc->offCount;
-        } else if (prop == "flags") {
-            ss >> spec->flags;
+            }
+            dc->onCount = on;
+            dc->offCount = off;
+            break;
+        }
+        case P_FLAGS:
+            ok = nextNumber(rest, spec->flags);
+            break;
+        case P_BUFFER_COUNT:
+            ok = nextNumber(rest, spec->bufferCount);
+            break;
+        case P_PIPELINE_DEPTH:
+            ok = nextNumber(rest, spec->pipelineDepth);
+            break;
+        case P_PREFAULT:
+            spec->prefault = parseMask(rest, PREFAULT_FLAG, filename, n, prop);
+            break;
+        case P_READ_AHEAD:
+            ok = nextNumber(rest, spec->readAhead);
+            break;
+        case P_VERIFY: {
+            int verify = 0;
+            ok = nextNumber(rest, verify);
+            if (ok)
+                spec->verify = verify != 0;
+            break;
+        }
+        case P_VERIFY_MANIFEST:
+            spec->verifyManifest = nextWord(rest).str();
+            ok = !spec->verifyManifest.empty();
+            spec->verify = ok;
+            break;
+        case P_CAPTURE:
+            spec->capture = nextWord(rest).str();
+            ok = !spec->capture.empty();
+            if (ok && !rest.empty())
+                ok = nextNumber(rest, spec->captureFrames) && spec->captureFrames > 0;
+            break;
+        case P_CPU_AFFINITY: {
+            uint64_t mask;
+            ok = parseCpus(nextWord(rest), mask);
+            if (ok)
+                spec->sched.cpuMask = mask;
+            break;
+        }
+        case P_SCHED_POLICY:
+            spec->sched.policy = parseValue(nextWord(rest), SCHED_POLICY, filename, n, prop);
+            if (!rest.empty())
+                ok = nextNumber(rest, spec->sched.priority);
+            break;
+        case P_NICE:
+            ok = nextNumber(rest, spec->sched.nice) && spec->sched.nice >= -20 &&
+                spec->sched.nice <= 19;
+            if (!ok)
+                spec->sched.nice = SchedParams::NICE_KEEP;
+            break;
+        case P_UCLAMP: {
+            SchedParams& sched = spec->sched;
+            ok = nextNumber(rest, sched.uclampMin);
+            sched.uclampMax = 1024;
+            if (ok && !rest.empty())
+                ok = nextNumber(rest, sched.uclampMax);
+            ok = ok && sched.uclampMin >= 0 && sched.uclampMin <= sched.uclampMax &&
+                sched.uclampMax <= 1024;
+            if (!ok)
+                sched.uclampMin = sched.uclampMax = -1;
+            break;
+        }
+        case P_CGROUP:
+            spec->sched.cgroup = nextWord(rest).str();
+            ok = !spec->sched.cgroup.empty();
+            break;
+        case P_GL_GROUP:
+            spec->glGroup = nextWord(rest).str();
+            ok = !spec->glGroup.empty();
+            break;
+        case P_START_DELAY:
+            ok = nextNumber(rest, spec->startDelay);
+            break;
+        case P_STOP_TIME:
+            ok = nextNumber(rest, spec->stopTime);
+            break;
+        case P_PHASE:
+            if (st.inPhase) {
+                LOGW("%s:%u phase without end_phase", filename.c_str(), st.phaseLine);
+                endPhase(st);
+            }
+            st.phase = Phase();
+            ok = nextNumber(rest, st.phase.time);
+            st.inPhase = ok;
+            st.phaseLine = n;
+            break;
+        case P_END_PHASE:
+            if (!st.inPhase)
+                LOGW("%s:%u end_phase without phase, ignored", filename.c_str(), n);
+            endPhase(st);
+            break;
+        case P_KEYFRAME: {
+            Keyframe kf;
+            const Keyword *t = sKeywordTable.find(nextWord(rest), KEYFRAME_TRACK);
+            if (t == NULL) {
+                LOGW("%s:%u unknown %s track", filename.c_str(), n, prop);
+                return;
+            }
+            kf.track = (Keyframe::Track)t->value;
+            kf.b = 0;
+            kf.easing = Keyframe::LINEAR;
+
+            // Alpha has a single value
+            ok = nextNumber(rest, kf.time) && nextNumber(rest, kf.a) &&
+                (kf.track == Keyframe::ALPHA || nextNumber(rest, kf.b));
+            if (ok && !rest.empty()) {
+                const Keyword *e = sKeywordTable.find(nextWord(rest), KEYFRAME_EASING);
+                ok = e != NULL;
+                if (ok)
+                    kf.easing = (Keyframe::Easing)e->value;
+            }
+            if (ok)
+                spec->keyframes.push_back(kf);
+            break;
+        }
+        case P_KEYFRAME_LOOP: {
+            int loop = 0;
+            ok = nextNumber(rest, loop);
+            if (ok)
+                spec->keyframeLoop = loop != 0;
+            break;
+        }
+        case P_UPDATE_CONTENT_ON:
+            ok = nextNumber(rest, spec->updateParams.contentUpdateCycle.onCount);
+            break;
+        case P_UPDATE_CONTENT_OFF:
+            ok = nextNumber(rest, spec->updateParams.contentUpdateCycle.offCount);
+            break;
+        case P_UPDATE_CONTENT_SHOW_ON:
+            ok = nextNumber(rest, spec->updateParams.showCycle.onCount);
+            break;
+        case P_UPDATE_CONTENT_SHOW_OFF:
+            ok = nextNumber(rest, spec->updateParams.showCycle.offCount);
+            break;
+        default:
+            // 'surface' with arguments, or 'repeat'/'end' out of place
+            LOGW("'%s' ignored line '%.*s'", filename.c_str(), (int)line.len, line.p);
+            return;
+    }
+
+    // Common error check for simple parameters
+    if (!ok)
+        LOGW("%s:%u invalid %s", filename.c_str(), n, prop);
+}
+
+// Variables available to ${...} expressions in a repeat block
+struct RepeatVars {
+    long i;     // Instance index, 0..n-1
+    long n;     // Instance count
+    long col;   // i % cols
+    long row;   // i / cols
+    long cols;  // Grid columns, defaults to n
+    long rows;  // Grid rows
+};
+
+static long evalSum(const char*& p, const RepeatVars& v, bool& ok);
+
+inline void skipSpace(const char*& p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+}
+
+static long evalAtom(const char*& p, const RepeatVars& v, bool& ok)
+{
+    skipSpace(p);
+
+    if (*p == '(') {
+        p++;
+        long r = evalSum(p, v, ok);
+        skipSpace(p);
+        if (*p != ')') {
+            ok = false;
+            return 0;
+        }
+        p++;
+        return r;
+    }
+
+    if (*p == '-') {
+        p++;
+        return -evalAtom(p, v, ok);
+    }
+
+    if (isdigit(*p)) {
+        char *end;
+        long r = strtol(p, &end, 0);
+        p = end;
+        return r;
+    }
+
+    if (isalpha(*p)) {
+        const char *start = p;
+        while (isalnum(*p) || *p == '_')
+            p++;
+        string name(start, p - start);
+        if (name == "i")
+            return v.i;
+        if (name == "n")
+            return v.n;
+        if (name == "col")
+            return v.col;
+        if (name == "row")
+            return v.row;
+        if (name == "cols")
+            return v.cols;
+        if (name == "rows")
+            return v.rows;
+    }
+
+    ok = false;
+    return 0;
+}
+
+static long evalProduct(const char*& p, const RepeatVars& v, bool& ok)
+{
+    long r = evalAtom(p, v, ok);
+
+    while (ok) {
+        skipSpace(p);
+        char op = *p;
+        if (op != '*' && op != '/' && op != '%')
+            break;
+        p++;
+
+        long rhs = evalAtom(p, v, ok);
+        if (op == '*') {
+            r *= rhs;
+        } else if (rhs == 0) {
+            ok = false;
+        } else if (op == '/') {
+            r /= rhs;
         } else {
+            r %= rhs;
+        }
+    }
+    return r;
+}
+
+static long evalSum(const char*& p, const RepeatVars& v, bool& ok)
+{
+    long r = evalProduct(p, v, ok);
+
+    while (ok) {
+        skipSpace(p);
+        char op = *p;
+        if (op != '+' && op != '-')
+            break;
+        p++;
 
-            // Check for deprecated properties
-            if (prop == "update_content_on") {
-                ss >> spec->updateParams.contentUpdateCycle.onCount;
-            } else if (prop == "update_content_off") {
-                ss >> spec->updateParams.contentUpdateCycle.offCount;
-            } else if (prop == "update_content_show_on") {
-                ss >> spec->updateParams.showCycle.onCount;
-            } else if (prop == "update_content_show_off") {
-                ss >> spec->updateParams.showCycle.offCount;
+        long rhs = evalProduct(p, v, ok);
+        r = op == '+' ? r + rhs : r - rhs;
+    }
+    return r;
+}
+
+// Replace each ${expr} or ${expr:fmt} in line. fmt is x or X for hex, with
+// an optional zero padded width, e.g. ${i * 16:X8}
+static bool substitute(Token line, const RepeatVars& v, string& out)
+{
+    const char *p = line.p, *end = line.p + line.len;
+    out.clear();
+
+    while (true) {
+        const char *open = p;
+        while (open + 1 < end && !(open[0] == '$' && open[1] == '{'))
+            open++;
+        if (open + 1 >= end) {
+            out.append(p, end - p);
+            return true;
+        }
+
+        const char *close = (const char*)memchr(open, '}', end - open);
+        if (close == NULL)
+            return false;
+
+        out.append(p, open - p);
+
+        string expr(open + 2, close - open - 2);
+        string fmt;
+        size_t colon = expr.find(':');
+        if (colon != string::npos) {
+            fmt = expr.substr(colon + 1);
+            expr.erase(colon);
+        }
+
+        bool ok = true;
+        const char *e = expr.c_str();
+        long value = evalSum(e, v, ok);
+        skipSpace(e);
+        if (!ok || *e != '\0')
+            return false;
+
+        char buf[32];
+        if (fmt.empty()) {
+            snprintf(buf, sizeof(buf), "%ld", value);
+        } else if (fmt[0] == 'x' || fmt[0] == 'X') {
+            int width = atoi(fmt.c_str() + 1);
+            snprintf(buf, sizeof(buf), fmt[0] == 'x' ? "%0*lx" : "%0*lX", width,
+                    (unsigned long)value);
+        } else {
+            return false;
+        }
+        out += buf;
+
+        p = close + 1;
+    }
+}
+
+// Block lines point into the mapped file, so this runs before it is unmapped
+static void expandRepeat(const vector<pair<unsigned int, Token> >& block, int count,
+        int columns, ParseState& st)
+{
+    const string& filename = st.filename;
+    RepeatVars v;
+    v.n = count;
+    v.cols = columns;
+    v.rows = (count + columns - 1) / columns;
+
+    string line;
+    for (int i = 0; i < count; i++) {
+        v.i = i;
+        v.col = i % columns;
+        v.row = i / columns;
+
+        for (size_t j = 0; j < block.size(); j++) {
+            if (!substitute(block[j].second, v, line)) {
+                LOGW("%s:%u invalid expression in '%s'", filename.c_str(),
+                        block[j].first, block[j].second.str().c_str());
+                continue;
+            }
+
+            Token t = trim(line);
+            if (t.empty())
+                continue;
+            parseLine(t, block[j].first, st);
+        }
+    }
+
+    LOGD("%s: repeat expanded %d lines %d times", filename.c_str(), (int)block.size(), count);
+}
+
+static void parseText(const char *data, size_t size, const string& filename,
+        List<sp<SurfaceSpec> >& specs)
+{
+    const char *p = data, *end = data + size;
+    ParseState st(filename, specs);
+    unsigned int n = 0;
+
+    // Lines collected between 'repeat' and 'end', with line numbers
+    bool repeating = false;
+    unsigned int repeatLine = 0;
+    int repeatCount = 0, repeatColumns = 0;
+    vector<pair<unsigned int, Token> > block;
+
+    while (p < end) {
+        const char *eol = (const char*)memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+
+        Token line = trim(Token(p, eol - p));
+        p = eol + 1;
+        n++;
+        if (line.empty() || line.p[0] == '#')
+            continue;
+
+        Token rest = line;
+        const Keyword *k = sKeywordTable.find(nextWord(rest), PROPERTY);
+        int prop = k != NULL ? k->value : -1;
+
+        if (repeating) {
+            if (prop == P_END && rest.empty()) {
+                repeating = false;
+                expandRepeat(block, repeatCount, repeatColumns, st);
+                block.clear();
+            } else if (prop == P_REPEAT) {
+                LOGW("%s:%u nested repeat not supported, ignored", filename.c_str(), n);
             } else {
-                LOGW("'%s' ignored line '%s'", filename.c_str(), line.c_str());
+                block.push_back(make_pair(n, line));
             }
+            continue;
         }
 
-        // Common error check for simple parameters
-        if (ss.fail())
-            LOGW("'%s' invalid %s", filename.c_str(), prop.c_str());
+        if (prop == P_REPEAT) {
+            if (!nextNumber(rest, repeatCount) || repeatCount < 0) {
+                LOGW("%s:%u invalid repeat count", filename.c_str(), n);
+                repeatCount = 0;
+            }
+            if (!nextNumber(rest, repeatColumns) || repeatColumns <= 0)
+                repeatColumns = repeatCount > 0 ? repeatCount : 1;
+            repeating = true;
+            repeatLine = n;
+            continue;
+        }
+
+        parseLine(line, n, st);
+    }
+
+    if (repeating) {
+        LOGW("%s:%u repeat without end, expanding to end of file", filename.c_str(), repeatLine);
+        expandRepeat(block, repeatCount, repeatColumns, st);
+    }
+
+    if (st.inPhase) {
+        LOGW("%s:%u phase without end_phase", filename.c_str(), st.phaseLine);
+        endPhase(st);
     }
 
-    f.close();
+    if (st.spec != 0)
+        specs.push_back(st.spec);
+}
+
+bool SpecParser::parseFile(string filename, List<sp<SurfaceSpec> >& specs)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOGE("unable to open '%s' for reading", filename.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOGE("unable to stat '%s': %s", filename.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *data = NULL;
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            LOGE("unable to map '%s': %s", filename.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
 
-    if (spec != 0)
-        specs.push_back(spec);
+    parseText((const char*)data, size, filename, specs);
 
+    if (data != NULL)
+        munmap(data, size);
     return true;
 }
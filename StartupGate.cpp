@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "adtf"
+
+#include <algorithm>
+#include <unistd.h>
+
+#include "LocalTypes.h"
+#include "StartupGate.h"
+
+using namespace android;
+using namespace std;
+
+StartupGate::StartupGate() : mFree(1), mParties(0), mArrived(0), mFailed(0), mStart(0),
+    mFirst(0), mOpen(true), mHeld(false)
+{
+}
+
+void StartupGate::init(unsigned int slots, unsigned int parties, bool held)
+{
+    Mutex::Autolock _l(mLock);
+
+    if (slots == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        slots = cpus > 0 ? cpus : 1;
+    }
+    mFree = slots;
+    mParties = parties;
+    mArrived = mFailed = 0;
+    mStart = mFirst = 0;
+    mHeld = held;
+    mOpen = parties == 0 && !held;
+    mSum = mMax = StartupTimes();
+
+    LOGD("startup of %u surfaces in %u slots", parties, slots);
+}
+
+void StartupGate::acquire()
+{
+    Mutex::Autolock _l(mLock);
+
+    if (mStart == 0)
+        mStart = systemTime();
+    while (mFree == 0)
+        mCondition.wait(mLock);
+    mFree--;
+}
+
+void StartupGate::release()
+{
+    Mutex::Autolock _l(mLock);
+    mFree++;
+    mCondition.broadcast();
+}
+
+void StartupGate::arrive(const char *name, bool ok, StartupTimes& times)
+{
+    Mutex::Autolock _l(mLock);
+
+    nsecs_t now = systemTime();
+    if (mFirst == 0)
+        mFirst = now;
+
+    if (ok) {
+        mSum.slot += times.slot;
+        mSum.surface += times.surface;
+        mSum.egl += times.egl;
+        mSum.content += times.content;
+        mSum.setup += times.setup;
+        mMax.slot = max(mMax.slot, times.slot);
+        mMax.surface = max(mMax.surface, times.surface);
+        mMax.egl = max(mMax.egl, times.egl);
+        mMax.content = max(mMax.content, times.content);
+        mMax.setup = max(mMax.setup, times.setup);
+    } else {
+        mFailed++;
+    }
+
+    mArrived++;
+    update();
+    while (!mOpen)
+        mCondition.wait(mLock);
+
+    times.barrier = ns2us(systemTime() - now);
+    LOGD("\"%s\" startup us slot: %lld surface: %lld egl: %lld content: %lld setup: %lld "
+            "barrier: %lld", name, (long long)times.slot, (long long)times.surface,
+            (long long)times.egl, (long long)times.content, (long long)times.setup,
+            (long long)times.barrier);
+}
+
+void StartupGate::leave()
+{
+    Mutex::Autolock _l(mLock);
+
+    if (mParties > 0)
+        mParties--;
+    update();
+}
+
+void StartupGate::waitArrived()
+{
+    Mutex::Autolock _l(mLock);
+
+    while (mArrived < mParties)
+        mCondition.wait(mLock);
+}
+
+void StartupGate::unhold()
+{
+    Mutex::Autolock _l(mLock);
+
+    mHeld = false;
+    update();
+}
+
+// Called with mLock held
+void StartupGate::update()
+{
+    if (mOpen || mArrived < mParties)
+        return;
+    if (mHeld)
+        mCondition.broadcast();
+    else
+        open();
+}
+
+// Called with mLock held
+void StartupGate::open()
+{
+    mOpen = true;
+    mCondition.broadcast();
+
+    unsigned int n = mArrived - mFailed;
+    if (n == 0)
+        return;
+
+    nsecs_t now = systemTime();
+    LOGI("startup %u surfaces (%u failed) in %lldus, %lldus from first to last ready, "
+            "us avg/max slot: %lld/%lld surface: %lld/%lld egl: %lld/%lld "
+            "content: %lld/%lld setup: %lld/%lld", n, mFailed,
+            (long long)ns2us(now - mStart), (long long)ns2us(now - mFirst),
+            (long long)(mSum.slot / n), (long long)mMax.slot,
+            (long long)(mSum.surface / n), (long long)mMax.surface,
+            (long long)(mSum.egl / n), (long long)mMax.egl,
+            (long long)(mSum.content / n), (long long)mMax.content,
+            (long long)(mSum.setup / n), (long long)mMax.setup);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2012, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _STARTUP_GATE_H
+#define _STARTUP_GATE_H
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// Where a surface thread's bring-up went, in us
+struct StartupTimes {
+    nsecs_t slot;       // Waiting for a bring-up slot
+    nsecs_t surface;    // createSurface
+    nsecs_t egl;        // initEgl
+    nsecs_t content;    // Subclass preparation, file mapping, textures, ...
+    nsecs_t setup;      // Window setup up to and including the first frame
+    nsecs_t barrier;    // Waiting for the other surfaces starting with it
+
+    StartupTimes() : slot(0), surface(0), egl(0), content(0), setup(0), barrier(0) {}
+};
+
+// Bring-up of the surfaces that start together. At most slots of them
+// prepare at once, so that a large case doesn't have every thread fighting
+// for the CPUs and the composer, and none of them enters its update loop
+// before all are prepared, so that all measure from the same moment. A
+// surface that fails to prepare still arrives, as does one that is stopped
+// before it started, so nobody waits for it.
+class StartupGate {
+    public:
+        StartupGate();
+
+        // 0 slots for one per CPU. A held gate stays shut when the last
+        // party arrives, until unhold().
+        void init(unsigned int slots, unsigned int parties, bool held = false);
+
+        void acquire();
+        void release();
+
+        // Blocks until every party has arrived
+        void arrive(const char *name, bool ok, StartupTimes& times);
+
+        // A party that will never arrive
+        void leave();
+
+        // Blocks until every party has arrived or left, then opens a held
+        // gate; what has to line up with the arrivals goes in between
+        void waitArrived();
+        void unhold();
+
+    private:
+        void update();
+        void open();
+
+        Mutex mLock;
+        Condition mCondition;
+        unsigned int mFree;
+        unsigned int mParties;
+        unsigned int mArrived;
+        unsigned int mFailed;
+        nsecs_t mStart;     // First acquire
+        nsecs_t mFirst;     // First arrival
+        bool mOpen;
+        bool mHeld;
+
+        // Sums and maxima over the arrived parties
+        StartupTimes mSum;
+        StartupTimes mMax;
+};
+
+#endif
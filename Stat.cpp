@@ -33,7 +33,11 @@
 #define LOG_TAG "adtf"
 
 #include <algorithm>
+#include <iomanip>
 #include <sstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "LocalTypes.h"
 #include "Stat.h"
@@ -41,13 +45,61 @@
 using namespace android;
 using namespace std;
 
-Stat::Stat()
+#ifndef RUSAGE_THREAD
+#define RUSAGE_THREAD 1
+#endif
+
+// Faults taken by the calling thread so far
+static void threadFaults(long& major, long& minor)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+        major = ru.ru_majflt;
+        minor = ru.ru_minflt;
+    } else {
+        major = minor = 0;
+    }
+}
+
+// CPU the calling thread is on, -1 if unknown
+static int currentCpu()
+{
+#ifdef __NR_getcpu
+    unsigned int cpu;
+    if (syscall(__NR_getcpu, &cpu, NULL, NULL) == 0)
+        return cpu;
+#endif
+    return -1;
+}
+
+Mutex Stat::sTotalLock;
+Stat::Totals Stat::sTotals;
+
+// Everything clear() folds into the totals starts at zero
+Stat::Stat() : mTransCount(0), mTransMax(0), mTransAvg(0), mUpdateCount(0), mUpdateMax(0),
+    mUpdateAvg(0), mUpdateStart(0), mDrawing(false), mPresentSynthetic(false), mBytesRead(0),
+    mBytesWritten(0), mSharedThread(false), mLastCpu(-1), mRunFrames(0), mRunMisses(0)
 {
     clear();
 }
 
 void Stat::clear()
 {
+    if (mBytesRead > 0 || mBytesWritten > 0 || mUpdateCount > 0 || mTransCount > 0) {
+        Mutex::Autolock _l(sTotalLock);
+        sTotals.read += mBytesRead;
+        sTotals.written += mBytesWritten;
+        sTotals.updates += mUpdateCount;
+        sTotals.updateTime += mUpdateAvg * mUpdateCount;
+        sTotals.updateMax = max(sTotals.updateMax, (uint64_t)mUpdateMax);
+        sTotals.transactions += mTransCount;
+        sTotals.transTime += mTransAvg * mTransCount;
+        sTotals.transMax = max(sTotals.transMax, (uint64_t)mTransMax);
+    }
+    mBytesRead = 0;
+    mBytesWritten = 0;
+
     mTransCount = 0;
     mTransMin = LONGLONG_MAX;
     mTransMax = 0;;
@@ -58,13 +110,67 @@ void Stat::clear()
     mUpdateMax = 0;
     mUpdateAvg = 0;
 
+    mDrawCount = 0;
+    mDrawMax = 0;
+    mDrawAvg = 0;
+    mSwitchCount = 0;
+    mSwitchMax = 0;
+    mSwitchAvg = 0;
+
+    mDequeueCount = 0;
+    mDequeueMax = 0;
+    mDequeueAvg = 0;
+    mQueueSamples = 0;
+    mQueueBehind = 0;
+
+    mPresentCount = 0;
+    mPresentMax = 0;
+    mPresentAvg = 0;
+
+    mUnderrunCount = 0;
+
+    mVerifyCount = 0;
+    mVerifyBacklog = 0;
+    mVerifyDropped = 0;
+    mVerifyMismatches = 0;
+
+    mCaptureCount = 0;
+    mCaptureDropped = 0;
+
     mPosCount = 0;
     mSizeCount = 0;
     mVisCount = 0;
+    mAlphaCount = 0;
+
+    mMigrations = 0;
+    for (int i = 0; i < MAX_CPUS; i++)
+        mCpuUpdates[i] = mCpuTime[i] = 0;
+
+    mFrameCount = 0;
+    mMissCount = 0;
+
+    for (int i = 0; i < PerfCounters::COUNTER_MAX; i++)
+        mPerfTotals[i] = 0;
+    mPerfCount = 0;
+
+    threadFaults(mMajorFaults, mMinorFaults);
 
     mClear.start();
 }
 
+// Must be called from the thread whose updates are measured
+bool Stat::enablePerf()
+{
+    return mPerf.open();
+}
+
+// Updates run on a thread shared with other surfaces (a GL group), whose
+// fault counts can't be told apart per surface
+void Stat::setSharedThread()
+{
+    mSharedThread = true;
+}
+
 nsecs_t Stat::sinceClear()
 {
     mClear.stop();
@@ -90,7 +196,10 @@ void Stat::closeTransaction()
 
 void Stat::startUpdate()
 {
+    mPerf.start();
     mUpdate.start();
+    mUpdateStart = systemTime();
+    mDrawing = true;
 }
 
 void Stat::doneUpdate()
@@ -98,10 +207,103 @@ void Stat::doneUpdate()
     mUpdate.stop();
     mUpdateCount++;
 
+    if (mPerf.isOpen()) {
+        uint64_t values[PerfCounters::COUNTER_MAX];
+        if (mPerf.stop(values)) {
+            for (int i = 0; i < PerfCounters::COUNTER_MAX; i++)
+                mPerfTotals[i] += values[i];
+            mPerfCount++;
+        }
+    }
+
     nsecs_t duration = mUpdate.durationUsecs();
     mUpdateAvg = mUpdateAvg + (duration - mUpdateAvg) / mUpdateCount;
     mUpdateMin = min(mUpdateMin, duration);
     mUpdateMax = max(mUpdateMax, duration);
+    mUpdateHist.add(duration);
+
+    int cpu = currentCpu();
+    if (cpu >= 0 && cpu < MAX_CPUS) {
+        if (mLastCpu >= 0 && cpu != mLastCpu)
+            mMigrations++;
+        mLastCpu = cpu;
+        mCpuUpdates[cpu]++;
+        mCpuTime[cpu] += duration;
+    }
+}
+
+// GL surfaces call this at the first swap of an update
+void Stat::doneDraw()
+{
+    if (!mDrawing)
+        return;
+    mDrawing = false;
+    mDrawCount++;
+
+    nsecs_t duration = ns2us(systemTime() - mUpdateStart);
+    mDrawAvg = mDrawAvg + (duration - mDrawAvg) / mDrawCount;
+    mDrawMax = max(mDrawMax, duration);
+}
+
+void Stat::madeCurrent(nsecs_t duration)
+{
+    mSwitchCount++;
+    mSwitchAvg = mSwitchAvg + (duration - mSwitchAvg) / mSwitchCount;
+    mSwitchMax = max(mSwitchMax, duration);
+}
+
+// Brackets a call that may block until the consumer releases a buffer
+void Stat::startDequeue()
+{
+    mDequeue.start();
+}
+
+void Stat::doneDequeue()
+{
+    mDequeue.stop();
+    mDequeueCount++;
+
+    nsecs_t duration = mDequeue.durationUsecs();
+    mDequeueAvg = mDequeueAvg + (duration - mDequeueAvg) / mDequeueCount;
+    mDequeueMax = max(mDequeueMax, duration);
+    mDequeueHist.add(duration);
+}
+
+void Stat::queueSample(bool behind)
+{
+    mQueueSamples++;
+    if (behind)
+        mQueueBehind++;
+}
+
+// Time from queueing a frame until it was on screen (us)
+void Stat::presentDone(nsecs_t latency, bool synthetic)
+{
+    mPresentSynthetic = synthetic;
+    mPresentCount++;
+    mPresentAvg = mPresentAvg + (latency - mPresentAvg) / mPresentCount;
+    mPresentMax = max(mPresentMax, latency);
+    mPresentHist.add(latency);
+}
+
+void Stat::addUnderruns(unsigned int count)
+{
+    mUnderrunCount += count;
+}
+
+void Stat::addVerified(unsigned int hashed, unsigned int backlog, unsigned int dropped,
+        unsigned int mismatches)
+{
+    mVerifyCount += hashed;
+    mVerifyBacklog = max(mVerifyBacklog, (nsecs_t)backlog);
+    mVerifyDropped += dropped;
+    mVerifyMismatches += mismatches;
+}
+
+void Stat::addCaptured(unsigned int written, unsigned int dropped)
+{
+    mCaptureCount += written;
+    mCaptureDropped += dropped;
 }
 
 void Stat::setPosition()
@@ -119,7 +321,41 @@ void Stat::setVisibility()
     mVisCount++;
 }
 
+void Stat::setAlpha()
+{
+    mAlphaCount++;
+}
+
+void Stat::addBytes(uint64_t read, uint64_t written)
+{
+    mBytesRead += read;
+    mBytesWritten += written;
+}
+
+// One iteration with a deadline, missed if it ran past it
+void Stat::frameDone(bool missed)
+{
+    mFrameCount++;
+    mRunFrames++;
+    if (missed) {
+        mMissCount++;
+        mRunMisses++;
+    }
+}
+
+// Totals since construction, not affected by clear()
+void Stat::getFrameCounts(uint64_t& frames, uint64_t& misses)
+{
+    frames = mRunFrames;
+    misses = mRunMisses;
+}
+
 void Stat::dump(string what)
+{
+    LOGI("stat \"%s\"%s", what.c_str(), summary().c_str());
+}
+
+string Stat::summary()
 {
     stringstream ss;
     nsecs_t count, avg, min, max;
@@ -142,10 +378,134 @@ void Stat::dump(string what)
 
     ss << " u: " << count << "/" << avg << "/" << min << "/" << max;
 
+    if (mDrawCount > 0)
+        ss << " dr: " << mDrawCount << "/" << mDrawAvg << "/" << mDrawMax;
+    if (mSwitchCount > 0)
+        ss << " mc: " << mSwitchCount << "/" << mSwitchAvg << "/" << mSwitchMax;
+
     ss << " p: " << mPosCount;
     ss << " s: " << mSizeCount;
     ss << " v: " << mVisCount;
-    ss << " d: " << sinceClear();
+    if (mAlphaCount > 0)
+        ss << " a: " << mAlphaCount;
+    if (mDequeueCount > 0)
+        ss << " q: " << mDequeueCount << "/" << mDequeueAvg << "/" << mDequeueMax;
+    if (mQueueSamples > 0)
+        ss << " qb: " << mQueueBehind << "/" << mQueueSamples;
+    if (mPresentCount > 0)
+        ss << (mPresentSynthetic ? " pr~: " : " pr: ") << mPresentCount << "/" << mPresentAvg << "/" << mPresentMax;
+    if (mUnderrunCount > 0)
+        ss << " ur: " << mUnderrunCount;
+    if (mVerifyCount > 0 || mVerifyDropped > 0)
+        ss << " vf: " << mVerifyCount << "/" << mVerifyBacklog << "/" << mVerifyDropped
+            << "/" << mVerifyMismatches;
+    if (mCaptureCount > 0 || mCaptureDropped > 0)
+        ss << " cp: " << mCaptureCount << "/" << mCaptureDropped;
+    if (mFrameCount > 0)
+        ss << " m: " << mMissCount << "/" << mFrameCount;
+
+    // Migrations, then updates and average update time per CPU used
+    if (mLastCpu >= 0 && mUpdateCount > 0) {
+        ss << " c: " << mMigrations << " [";
+        const char *sep = "";
+        for (int i = 0; i < MAX_CPUS; i++) {
+            if (mCpuUpdates[i] == 0)
+                continue;
+            ss << sep << i << ":" << mCpuUpdates[i] << "/" << mCpuTime[i] / mCpuUpdates[i];
+            sep = " ";
+        }
+        ss << "]";
+    }
+
+    // Counter totals for all updates in this interval, '-' if not supported
+    if (mPerf.isOpen()) {
+        ss << " pc: " << mPerfCount;
+        for (int i = 0; i < PerfCounters::COUNTER_MAX; i++) {
+            if (mPerf.available((PerfCounters::Counter)i))
+                ss << "/" << mPerfTotals[i];
+            else
+                ss << "/-";
+        }
+    }
+
+    // Major/minor faults of the updating thread, stat must be read from it
+    if (!mSharedThread) {
+        long major, minor;
+        threadFaults(major, minor);
+        ss << " f: " << major - mMajorFaults << "/" << minor - mMinorFaults;
+    }
+
+    // Bytes per usec is MB/s
+    nsecs_t duration = sinceClear();
+    if (duration > 0) {
+        ss << fixed << setprecision(1);
+        ss << " b: " << (double)mBytesRead / duration << "/" << (double)mBytesWritten / duration;
+    }
+    ss << " d: " << duration;
+
+    return ss.str();
+}
+
+string Stat::histograms()
+{
+    stringstream ss;
+
+    ss << "u: " << mUpdateHist.count() << "/" << mUpdateHist.avg() << "/"
+        << mUpdateHist.min() << "/" << mUpdateHist.max();
+    ss << " p50: " << mUpdateHist.percentile(50);
+    ss << " p99: " << mUpdateHist.percentile(99);
+    ss << " [" << mUpdateHist.toString() << "]";
+
+    if (mDequeueHist.count() > 0) {
+        ss << " dq: " << mDequeueHist.count() << "/" << mDequeueHist.avg() << "/"
+            << mDequeueHist.min() << "/" << mDequeueHist.max();
+        ss << " p50: " << mDequeueHist.percentile(50);
+        ss << " p99: " << mDequeueHist.percentile(99);
+        ss << " [" << mDequeueHist.toString() << "]";
+    }
 
-    LOGI("stat \"%s\"%s", what.c_str(), ss.str().c_str());
+    if (mPresentHist.count() > 0) {
+        ss << (mPresentSynthetic ? " pr~: " : " pr: ") << mPresentHist.count() << "/" << mPresentHist.avg() << "/"
+            << mPresentHist.min() << "/" << mPresentHist.max();
+        ss << " p50: " << mPresentHist.percentile(50);
+        ss << " p99: " << mPresentHist.percentile(99);
+        ss << " [" << mPresentHist.toString() << "]";
+    }
+
+    return ss.str();
+}
+
+// Call after all surfaces have done their final clear()
+void Stat::dumpTotal(nsecs_t durationUs)
+{
+    Mutex::Autolock _l(sTotalLock);
+
+    if (durationUs <= 0)
+        return;
+
+    const Totals& t = sTotals;
+    LOGI("stat total r: %llu (%.1f MB/s) w: %llu (%.1f MB/s) u: %llu/%llu/%llu "
+            "t: %llu/%llu/%llu d: %lld",
+            (unsigned long long)t.read, (double)t.read / durationUs,
+            (unsigned long long)t.written, (double)t.written / durationUs,
+            (unsigned long long)t.updates,
+            (unsigned long long)(t.updates > 0 ? t.updateTime / t.updates : 0),
+            (unsigned long long)t.updateMax,
+            (unsigned long long)t.transactions,
+            (unsigned long long)(t.transactions > 0 ? t.transTime / t.transactions : 0),
+            (unsigned long long)t.transMax,
+            (long long)durationUs);
+}
+
+Stat::Totals Stat::getTotals()
+{
+    Mutex::Autolock _l(sTotalLock);
+    return sTotals;
+}
+
+// Before a run, so that its totals don't include earlier runs in the process
+void Stat::resetTotals()
+{
+    Mutex::Autolock _l(sTotalLock);
+    sTotals = Totals();
 }
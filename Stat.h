@@ -34,24 +34,65 @@
 #define _STAT_H
 
 #include <utils/Log.h>
+#include <utils/threads.h>
 #include <utils/Timers.h>
 
+#include "Histogram.h"
+#include "PerfCounters.h"
+
 using namespace android;
 using namespace std;
 
 class Stat {
     public:
+        // What all surfaces did over the run, folded in by clear(), times in us
+        struct Totals {
+            uint64_t read;
+            uint64_t written;
+            uint64_t updates;
+            uint64_t updateTime;
+            uint64_t updateMax;
+            uint64_t transactions;
+            uint64_t transTime;
+            uint64_t transMax;
+
+            Totals() : read(0), written(0), updates(0), updateTime(0), updateMax(0),
+                transactions(0), transTime(0), transMax(0) {}
+        };
+
         Stat();
         void clear();
+        bool enablePerf();
+        void setSharedThread();
         nsecs_t sinceClear();
         void openTransaction();
         void closeTransaction();
         void startUpdate();
         void doneUpdate();
+        void doneDraw();
+        void madeCurrent(nsecs_t duration);
+        void startDequeue();
+        void doneDequeue();
+        void queueSample(bool behind);
+        void presentDone(nsecs_t latency, bool synthetic);
+        void addUnderruns(unsigned int count);
+        void addVerified(unsigned int hashed, unsigned int backlog, unsigned int dropped,
+                unsigned int mismatches);
+        void addCaptured(unsigned int written, unsigned int dropped);
         void setPosition();
         void setSize();
         void setVisibility();
+        void setAlpha();
+        void addBytes(uint64_t read, uint64_t written);
+        void frameDone(bool missed);
+        void getFrameCounts(uint64_t& frames, uint64_t& misses);
         void dump(string what);
+        string summary();
+        string histograms();
+
+        static void dumpTotal(nsecs_t durationUs);
+        static Totals getTotals();
+        static void resetTotals();
 
     private:
         DurationTimer mClear;
@@ -67,10 +108,82 @@ class Stat {
         nsecs_t mUpdateMin;
         nsecs_t mUpdateMax;
         nsecs_t mUpdateAvg;
+        Histogram mUpdateHist; // Not cleared, covers the whole run
+
+        // GL only, from the start of the update to its swap
+        nsecs_t mUpdateStart;
+        bool mDrawing;
+        nsecs_t mDrawCount;
+        nsecs_t mDrawMax;
+        nsecs_t mDrawAvg;
+
+        // Binding the surface on a context shared with other surfaces
+        nsecs_t mSwitchCount;
+        nsecs_t mSwitchMax;
+        nsecs_t mSwitchAvg;
+
+        // Time blocked waiting for a free buffer
+        DurationTimer mDequeue;
+        nsecs_t mDequeueCount;
+        nsecs_t mDequeueMax;
+        nsecs_t mDequeueAvg;
+        Histogram mDequeueHist; // Not cleared, covers the whole run
+
+        // How often the consumer had more than one buffer queued
+        nsecs_t mQueueSamples;
+        nsecs_t mQueueBehind;
+
+        // Queue to present, per frame
+        nsecs_t mPresentCount;
+        nsecs_t mPresentMax;
+        nsecs_t mPresentAvg;
+        Histogram mPresentHist; // Not cleared, covers the whole run
+        bool mPresentSynthetic; // Estimated rather than reported by the display
+
+        nsecs_t mUnderrunCount; // Frames the content source wasn't ready with
+
+        // Frame checksumming, backlog as the most frames waiting at once
+        nsecs_t mVerifyCount;
+        nsecs_t mVerifyBacklog;
+        nsecs_t mVerifyDropped;
+        nsecs_t mVerifyMismatches;
+
+        nsecs_t mCaptureCount;
+        nsecs_t mCaptureDropped;
 
         nsecs_t mPosCount;
         nsecs_t mSizeCount;
         nsecs_t mVisCount;
+        nsecs_t mAlphaCount;
+
+        PerfCounters mPerf;
+        uint64_t mPerfTotals[PerfCounters::COUNTER_MAX];
+        nsecs_t mPerfCount;
+
+        uint64_t mBytesRead;
+        uint64_t mBytesWritten;
+
+        // Thread's fault counts when the interval started, not reported when
+        // the thread updates other surfaces as well
+        bool mSharedThread;
+        long mMajorFaults;
+        long mMinorFaults;
+
+        // CPU each update finished on, with the update time summed per CPU
+        // (us) and the times it differed from the one before
+        enum { MAX_CPUS = 32 };
+        int mLastCpu;   // Not cleared
+        nsecs_t mMigrations;
+        nsecs_t mCpuUpdates[MAX_CPUS];
+        nsecs_t mCpuTime[MAX_CPUS];
+
+        nsecs_t mFrameCount;
+        nsecs_t mMissCount;
+        uint64_t mRunFrames;
+        uint64_t mRunMisses;
+
+        static Mutex sTotalLock;
+        static Totals sTotals;
 };
 
 #endif
@@ -32,9 +32,18 @@
 
 #define LOG_TAG "adtf"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sstream>
 #include <vector>
 
+#include "GlGroup.h"
 #include "TestBase.h"
 
 using namespace android;
@@ -46,7 +55,10 @@ TestBase::TestBase(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
     mExitLock(exitLock), mExitCondition(exitCondition), mUpdateCount(0),
     mUpdating(true), mVisibleCount(0), mVisible(false), mPosCount(0),
     mSteppingPos(true), mSizeCount(0), mSteppingSize(true), mLeftStepFactor(1),
-    mTopStepFactor(1), mWidthStepFactor(1), mHeightStepFactor(1)
+    mTopStepFactor(1), mWidthStepFactor(1), mHeightStepFactor(1), mAlpha(255),
+    mAnimStart(0), mGate(NULL), mBarrier(false), mGlGroup(NULL), mOwnsContext(true),
+    mGrouped(false), mLoopDone(false), mIteration(0), mPausedAt(0), mUnderruns(0),
+    mPaused(false), mLatency(spec->updateParams.latency)
 {
 #ifndef ADTF_ICS_AND_EARLIER
     mEventReceiver = NULL;
@@ -56,6 +68,12 @@ TestBase::TestBase(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
 
 TestBase::~TestBase()
 {
+    if (mPipeline != 0)
+        mPipeline->stop();
+    if (mVerifier != 0)
+        mVerifier->stop();
+    if (mCapture != 0)
+        mCapture->stop();
     freeEgl();
 
 #ifndef ADTF_ICS_AND_EARLIER
@@ -76,8 +94,166 @@ bool TestBase::done()
     return exitPending();
 }
 
+void TestBase::pause()
+{
+    Mutex::Autolock _l(mControlLock);
+    mPaused = true;
+}
+
+void TestBase::resume()
+{
+    Mutex::Autolock _l(mControlLock);
+    mPaused = false;
+    mControlCondition.broadcast();
+}
+
+// Like requestExit, but also wakes a paused thread
+void TestBase::stop()
+{
+    requestExit();
+    resume();
+}
+
+void TestBase::setLatency(unsigned int latency)
+{
+    Mutex::Autolock _l(mControlLock);
+    mLatency = latency;
+}
+
+// Latency changes right away, duty cycles are owned by the update thread
+// and change at the start of its next iteration
+void TestBase::applyPhase(const Phase& phase)
+{
+    Mutex::Autolock _l(mControlLock);
+    if (phase.fields & Phase::LATENCY)
+        mLatency = phase.latency;
+    mPendingPhase.merge(phase);
+    mPendingPhase.time = phase.time;
+}
+
+bool TestBase::paused()
+{
+    Mutex::Autolock _l(mControlLock);
+    return mPaused;
+}
+
+// Stat of the last completed interval
+string TestBase::snapshot()
+{
+    Mutex::Autolock _l(mControlLock);
+    return mSnapshot;
+}
+
+string TestBase::histograms()
+{
+    Mutex::Autolock _l(mControlLock);
+    return mHistSnapshot;
+}
+
+void TestBase::getFrameCounts(uint64_t& frames, uint64_t& misses)
+{
+    mStat.getFrameCounts(frames, misses);
+}
+
+void TestBase::publishStat()
+{
+    string summary = mStat.summary();
+    string hist = mStat.histograms();
+
+    Mutex::Autolock _l(mControlLock);
+    mSnapshot = summary;
+    mHistSnapshot = hist;
+}
+
+void TestBase::setStartupGate(StartupGate *gate, bool barrier)
+{
+    mGate = gate;
+    mBarrier = barrier;
+}
+
+void TestBase::setGlGroup(GlGroup *group)
+{
+    mGlGroup = group;
+}
+
+GlGroup *TestBase::glGroup()
+{
+    return mGlGroup;
+}
+
+void TestBase::enterGroup()
+{
+    Mutex::Autolock _l(mControlLock);
+    mGrouped = true;
+}
+
+// Exited as far as the manager can tell, for a grouped surface that's all
+// there is
+void TestBase::loopDone()
+{
+    signalExit();
+
+    Mutex::Autolock _l(mControlLock);
+    mLoopDone = true;
+    mControlCondition.broadcast();
+}
+
+// join() for a surface whether or not it runs on a thread of its own
+void TestBase::waitExit()
+{
+    {
+        Mutex::Autolock _l(mControlLock);
+        if (mGrouped) {
+            while (!mLoopDone)
+                mControlCondition.wait(mControlLock);
+            return;
+        }
+    }
+    join();
+}
+
+// Whatever the subclass does besides creating the surface and EGL counts as
+// content preparation
 status_t TestBase::readyToRun()
 {
+    nsecs_t t = systemTime();
+    if (mGate != NULL)
+        mGate->acquire();
+    nsecs_t start = systemTime();
+    mStartup.slot = ns2us(start - t);
+
+    status_t status = prepare();
+
+    mStartup.content = ns2us(systemTime() - start) - mStartup.surface - mStartup.egl -
+            mStartup.setup;
+    if (mGate != NULL) {
+        mGate->release();
+        if (mBarrier)
+            mGate->arrive(mSpec->name.c_str(), status == NO_ERROR, mStartup);
+    }
+    if (status != NO_ERROR)
+        return status;
+
+    // Measure from the common start rather than from each surface's own
+    if (mBarrier)
+        resetStart();
+    return NO_ERROR;
+}
+
+void TestBase::resetStart()
+{
+    mStat.clear();
+    mLastIter = systemTime();
+}
+
+const StartupTimes& TestBase::startupTimes()
+{
+    return mStartup;
+}
+
+status_t TestBase::prepare()
+{
+    nsecs_t setupStart = systemTime();
     status_t status = NO_ERROR;
 
     status = mComposerClient->initCheck();
@@ -121,12 +297,57 @@ status_t TestBase::readyToRun()
         return status;
     }
 
+    if (mGlGroup == NULL || mGlGroup->claimScheduling(mSpec))
+        applyScheduling();
+
     mStat.clear();
+    if (mGlGroup != NULL)
+        mStat.setSharedThread();
+
+    if (mSpec->renderFlag(RenderFlags::PERF) && !mStat.enablePerf())
+        LOGW("\"%s\" perf counters unavailable, continuing without", mSpec->name.c_str());
 
     sp<Surface> surface = mSurfaceControl->getSurface();
     sp<ANativeWindow> window(surface);
     ANativeWindow *w = window.get();
 
+    mPresent.init(window, vsyncPeriod());
+    LOGD("\"%s\" %s present times", mSpec->name.c_str(),
+            mPresent.synthetic() ? "synthetic" : "platform");
+
+    // Started before the first update so that every frame is covered. A few
+    // snapshots are enough as long as checksumming keeps up with the surface.
+    if (mSpec->verify) {
+        mVerifier = new FrameVerifier(mSpec->name, 4);
+        if ((!mSpec->verifyManifest.empty() && !mVerifier->setManifest(mSpec->verifyManifest)) ||
+                mVerifier->run("adtf verifier") != NO_ERROR) {
+            LOGE("\"%s\" failed to start frame verifier", mSpec->name.c_str());
+            mVerifier.clear();
+            signalExit();
+            return UNKNOWN_ERROR;
+        }
+    }
+
+    // Captured frames use the clip layout of the source geometry, so that a
+    // capture plays back as file content with the same spec
+    if (!mSpec->capture.empty()) {
+        if (mSpec->renderFlag(RenderFlags::GL)) {
+            LOGW("\"%s\" capture only applies to CPU content, ignored", mSpec->name.c_str());
+        } else {
+            const SrcGeometry& g = mSpec->srcGeometry;
+            size_t frameSize = mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12 ?
+                g.stride * g.height * 3 / 2 : g.stride * g.height * bufferBpp();
+            mCapture = new CaptureWriter(mSpec->name, frameSize, mSpec->captureFrames);
+            if (!mCapture->open(mSpec->capture) ||
+                    mCapture->run("adtf capture") != NO_ERROR) {
+                LOGE("\"%s\" failed to start capture", mSpec->name.c_str());
+                mCapture.clear();
+                signalExit();
+                return UNKNOWN_ERROR;
+            }
+        }
+    }
+
     if (!mSpec->renderFlag(RenderFlags::GL)) {
         if (mSpec->renderFlag(RenderFlags::ASYNC)) {
             status |= native_window_api_connect(w, NATIVE_WINDOW_API_MEDIA);
@@ -140,8 +361,9 @@ status_t TestBase::readyToRun()
         if (mSpec->bufferFormat != mSpec->format) {
             int min = 0;
             status |= w->query(w, NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS, &min);
-            status |= native_window_set_usage(w, GRALLOC_USAGE);
-            status |= native_window_set_buffer_count(w, min + 1);
+            status |= native_window_set_usage(w, bufferUsage());
+            if (mSpec->bufferCount == 0 && mSpec->pipelineDepth == 0)
+                status |= native_window_set_buffer_count(w, min + 1);
             status |= native_window_set_buffers_format(w, mSpec->bufferFormat);
             if (status != 0) {
                 LOGE("\"%s\" failed to configure buffer usage/count/format", mSpec->name.c_str());
@@ -161,7 +383,9 @@ status_t TestBase::readyToRun()
         return status;
     }
 
-    if (mSpec->srcGeometry.crop.isValid()) {
+    // The GLES 2 renderer crops and transforms as it draws
+    bool gles2 = mSpec->renderFlag(RenderFlags::GL) && glesVersion() == 2;
+    if (mSpec->srcGeometry.crop.isValid() && !gles2) {
         android_native_rect_t c;
         c.left = mSpec->srcGeometry.crop.left;
         c.top = mSpec->srcGeometry.crop.top;
@@ -175,7 +399,7 @@ status_t TestBase::readyToRun()
         }
     }
 
-    if (mSpec->transform != 0) {
+    if (mSpec->transform != 0 && !gles2) {
         LOGE("\"%s\" setting transform %d", mSpec->name.c_str(), mSpec->transform);
         status |= native_window_set_buffers_transform(w, mSpec->transform);
         if (status != 0) {
@@ -230,9 +454,30 @@ status_t TestBase::readyToRun()
     }
     mStat.doneUpdate();
 
+    // The first frame above is synchronous, the pipeline takes over from here
+    if (mSpec->pipelineDepth > 0) {
+        if (mSpec->renderFlag(RenderFlags::GL)) {
+            LOGW("\"%s\" pipeline_depth only applies to CPU content, ignored",
+                    mSpec->name.c_str());
+        } else {
+            native_window_set_usage(w, bufferUsage());
+            mPipeline = new BufferPipeline(mSpec->name, window, this, mSpec->pipelineDepth,
+                    mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12, bufferUsage());
+            status = mPipeline->run("adtf pipeline");
+            if (status != NO_ERROR) {
+                LOGE("\"%s\" failed to start buffer pipeline", mSpec->name.c_str());
+                mPipeline.clear();
+                signalExit();
+                return status;
+            }
+            LOGD("\"%s\" buffer pipeline depth %u", mSpec->name.c_str(), mSpec->pipelineDepth);
+        }
+    }
+
     mVisible = (mSpec->flags & ISurfaceComposer::eHidden) == 0;
     mVisibleCount = 0;
     mLastIter = systemTime();
+    mStartup.setup = ns2us(mLastIter - setupStart);
 
     return NO_ERROR;
 }
@@ -242,6 +487,8 @@ void TestBase::createSurface()
     if (mSurfaceControl != 0)
         return;
 
+    nsecs_t start = systemTime();
+
     int w = mSpec->outRect.width();
     int h = mSpec->outRect.height();
 
@@ -266,6 +513,151 @@ void TestBase::createSurface()
     );
     mWidth = w;
     mHeight = h;
+
+    configureBuffers();
+    mStartup.surface = ns2us(systemTime() - start);
+}
+
+// Runs before EGL or a media producer connects, so the count holds for
+// every render path
+void TestBase::configureBuffers()
+{
+    // The pipeline keeps depth buffers dequeued on top of what the consumer holds
+    int depth = mSpec->renderFlag(RenderFlags::GL) ? 0 : mSpec->pipelineDepth;
+    if (mSurfaceControl == 0 || (mSpec->bufferCount == 0 && depth == 0))
+        return;
+
+    sp<ANativeWindow> window(mSurfaceControl->getSurface());
+    ANativeWindow *w = window.get();
+
+    int min = 0;
+    if (w->query(w, NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS, &min) != 0) {
+        LOGE("\"%s\" failed to query min undequeued buffers", mSpec->name.c_str());
+        signalExit();
+        return;
+    }
+
+    int needed = min + max(depth, 1);
+    int count = mSpec->bufferCount;
+    if (count == 0) {
+        count = needed;
+    } else if (count < needed) {
+        LOGW("\"%s\" buffer_count %d too low, consumer holds %d and pipeline_depth is %d, "
+                "using %d", mSpec->name.c_str(), count, min, depth, needed);
+        count = needed;
+    }
+
+    if (native_window_set_buffer_count(w, count) != 0) {
+        LOGE("\"%s\" failed to set buffer count %d", mSpec->name.c_str(), count);
+        signalExit();
+        return;
+    }
+    LOGD("\"%s\" buffer count %d", mSpec->name.c_str(), count);
+}
+
+#ifdef __NR_sched_setattr
+// Not in the platform headers, layout as of the utilization clamp fields
+struct SchedAttr {
+    uint32_t size;
+    uint32_t policy;
+    uint64_t flags;
+    int32_t nice;
+    uint32_t priority;
+    uint64_t runtime;
+    uint64_t deadline;
+    uint64_t period;
+    uint32_t utilMin;
+    uint32_t utilMax;
+};
+
+#define SCHED_FLAG_KEEP_ALL         0x18
+#define SCHED_FLAG_UTIL_CLAMP_MIN   0x20
+#define SCHED_FLAG_UTIL_CLAMP_MAX   0x40
+#endif
+
+// Runs on the surface thread, all of these act on the calling thread only.
+// A setting that can't be applied, mostly for want of privileges or kernel
+// support, is reported and the thread runs on as it was.
+void TestBase::applyScheduling()
+{
+    const SchedParams& sched = mSpec->sched;
+    const char *name = mSpec->name.c_str();
+    pid_t tid = gettid();
+
+    // Raw mask so that it doesn't depend on the libc having cpu_set_t
+    if (sched.cpuMask != 0) {
+        uint64_t mask = sched.cpuMask;
+        if (syscall(__NR_sched_setaffinity, tid, sizeof(mask), &mask) != 0)
+            LOGW("\"%s\" can't set cpu affinity 0x%llx: %s", name,
+                    (unsigned long long)mask, strerror(errno));
+    }
+
+    if (!sched.cgroup.empty()) {
+        string tasks = sched.cgroup + "/tasks";
+        int fd = open(tasks.c_str(), O_WRONLY);
+        char buf[16];
+        int len = snprintf(buf, sizeof(buf), "%d", tid);
+        if (fd < 0 || write(fd, buf, len) != len)
+            LOGW("\"%s\" can't join cgroup '%s': %s", name, sched.cgroup.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+    }
+
+    if (sched.policy >= 0) {
+        struct sched_param param;
+        param.sched_priority = sched.priority;
+        if (sched_setscheduler(tid, sched.policy, &param) != 0)
+            LOGW("\"%s\" can't set sched policy %d priority %d: %s", name, sched.policy,
+                    sched.priority, strerror(errno));
+    }
+
+    if (sched.nice != SchedParams::NICE_KEEP && setpriority(PRIO_PROCESS, tid, sched.nice) != 0)
+        LOGW("\"%s\" can't set nice %d: %s", name, sched.nice, strerror(errno));
+
+    if (sched.uclampMin >= 0) {
+#ifdef __NR_sched_setattr
+        SchedAttr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.flags = SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP_MIN | SCHED_FLAG_UTIL_CLAMP_MAX;
+        attr.utilMin = sched.uclampMin;
+        attr.utilMax = sched.uclampMax;
+        if (syscall(__NR_sched_setattr, tid, &attr, 0) != 0)
+            LOGW("\"%s\" can't set uclamp %d-%d: %s", name, sched.uclampMin, sched.uclampMax,
+                    strerror(errno));
+#else
+        LOGW("\"%s\" uclamp not supported on this platform", name);
+#endif
+    }
+
+    LOGD("\"%s\" scheduled on cpu mask 0x%llx policy %d/%d nice %d", name,
+            (unsigned long long)sched.cpuMask, sched.policy, sched.priority,
+            sched.nice != SchedParams::NICE_KEEP ? sched.nice : getpriority(PRIO_PROCESS, tid));
+}
+
+// The consumer running behind means more than one buffer is queued, the
+// closest to queue occupancy the window reports
+bool TestBase::sampleQueue()
+{
+    sp<ANativeWindow> window(mSurfaceControl->getSurface());
+    ANativeWindow *w = window.get();
+    int behind = 0;
+
+    if (w->query(w, NATIVE_WINDOW_CONSUMER_RUNNING_BEHIND, &behind) != 0)
+        return false;
+    mStat.queueSample(behind != 0);
+    return behind != 0;
+}
+
+nsecs_t TestBase::vsyncPeriod()
+{
+    DisplayInfo info;
+
+    if (SurfaceComposerClient::getDisplayInfo(0, &info) != NO_ERROR || info.fps <= 0) {
+        LOGW("\"%s\" no display refresh rate, assuming 60Hz", mSpec->name.c_str());
+        return s2ns(1) / 60;
+    }
+    return (nsecs_t)(s2ns(1) / info.fps);
 }
 
 void TestBase::initEgl()
@@ -273,15 +665,29 @@ void TestBase::initEgl()
     if (!mSpec->renderFlag(RenderFlags::GL))
         return;
 
+    nsecs_t start = systemTime();
+    EglCache& cache = EglCache::get();
+    mEglDisplay = cache.display();
+    if (mEglDisplay == EGL_NO_DISPLAY) {
+        signalExit();
+        return;
+    }
+
     EGLConfig config = NULL;
-    mEglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    eglInitialize(mEglDisplay, 0, 0);
+    string key = configKey();
+    if (cache.findConfig(key, &config)) {
+        LOGD("\"%s\" using cached config for %s", mSpec->name.c_str(), key.c_str());
+        initEglSurface(config, start);
+        return;
+    }
+
     chooseEGLConfig(mEglDisplay, &config);
     if (config == NULL) {
         LOGE("\"%s\" chooseEGLConfig failed", mSpec->name.c_str());
         signalExit();
         return;
     }
+    cache.addConfig(key, config);
 
     // 33 attributes used for debugging
     int attr[] = {
@@ -325,9 +731,19 @@ void TestBase::initEgl()
             while (eglGetError() != EGL_SUCCESS);
     }
 
+    initEglSurface(config, start);
+}
+
+void TestBase::initEglSurface(EGLConfig config, nsecs_t start)
+{
     mEglSurface = eglCreateWindowSurface(mEglDisplay, config,
             mSurfaceControl->getSurface().get(), NULL);
-    mEglContext = createEGLContext(mEglDisplay, config);
+    if (mGlGroup != NULL) {
+        mEglContext = mGlGroup->context(mEglDisplay, config, glesVersion());
+        mOwnsContext = false;
+    } else {
+        mEglContext = createEGLContext(mEglDisplay, config);
+    }
     if (mEglContext == 0) {
         LOGE("\"%s\" createEGLContext failed", mSpec->name.c_str());
         signalExit();
@@ -338,6 +754,7 @@ void TestBase::initEgl()
         LOGE("\"%s\" eglMakeCurrent failed", mSpec->name.c_str());
         signalExit();
     }
+    mStartup.egl = ns2us(systemTime() - start);
 }
 
 bool TestBase::purgeEglBuffers()
@@ -371,10 +788,11 @@ void TestBase::freeEgl()
         mEglSurface = 0;
     }
     if (mEglContext != 0) {
-        eglDestroyContext(mEglDisplay, mEglContext);
+        if (mOwnsContext)
+            eglDestroyContext(mEglDisplay, mEglContext);
         mEglContext = 0;
     }
-    eglTerminate(mEglDisplay);
+    // The display belongs to EglCache and stays initialized
     mEglDisplay = EGL_NO_DISPLAY;
 }
 
@@ -431,6 +849,7 @@ void TestBase::chooseEGLConfig(EGLDisplay display, EGLConfig *config)
         EGL_GREEN_SIZE, g,
         EGL_BLUE_SIZE,  b,
         EGL_ALPHA_SIZE, a,
+        EGL_RENDERABLE_TYPE, glesVersion() == 2 ? EGL_OPENGL_ES2_BIT : EGL_OPENGL_ES_BIT,
         EGL_NONE
     };
 
@@ -466,10 +885,100 @@ void TestBase::chooseEGLConfig(EGLDisplay display, EGLConfig *config)
     eglChooseConfig(display, attribs, config, 1, &num);
 }
 
-// Must be overridden for GLES 2
+// The default choice only depends on the format and the GLES version
+string TestBase::configKey()
+{
+    stringstream ss;
+    ss << "format " << mSpec->format << " gles" << glesVersion();
+    return ss.str();
+}
+
 EGLContext TestBase::createEGLContext(EGLDisplay display, EGLConfig config)
 {
-    return eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+    const EGLint attribs[] = { EGL_CONTEXT_CLIENT_VERSION, glesVersion(), EGL_NONE };
+    return eglCreateContext(display, config, EGL_NO_CONTEXT, attribs);
+}
+
+int TestBase::glesVersion()
+{
+    return mSpec->renderFlag(RenderFlags::GLES2) ? 2 : 1;
+}
+
+// Memory traffic generated by a content update. For GL this is an estimate
+// based on texture and surface dimensions rather than measured traffic.
+void TestBase::accountBytes(uint64_t read, uint64_t written)
+{
+    mStat.addBytes(read, written);
+}
+
+// Content wasn't ready in time, may be called from the pipeline thread
+void TestBase::accountUnderrun()
+{
+    __sync_fetch_and_add(&mUnderruns, 1);
+}
+
+// Checksums a produced frame if verifying, may be called from the pipeline
+// thread. The frame is stamped as queued now.
+void TestBase::verifyFrame(uint64_t index, const void *data, size_t len, bool stable)
+{
+    if (mVerifier != 0)
+        mVerifier->submit(index, data, len, stable);
+}
+
+// Copies a filled buffer, before it is queued, to the capture writer. The
+// frame is dropped if the writer has no free frame. May be called from the
+// pipeline thread.
+void TestBase::captureBuffer(const char *bits, const char *uv, int stride, int width,
+        int height)
+{
+    if (mCapture == 0)
+        return;
+
+    char *frame = mCapture->acquire();
+    if (frame == 0)
+        return;
+
+    const SrcGeometry& g = mSpec->srcGeometry;
+    const int bpp = bufferBpp();
+    const size_t sl = stride * bpp, dl = g.stride * bpp;
+    const size_t bytes = min(g.width, width) * bpp;
+    const int h = min(g.height, height);
+
+    char *dst = frame;
+    for (int i = 0; i < h; i++, bits += sl, dst += dl)
+        memcpy(dst, bits, bytes);
+    if (uv != 0) {
+        dst = frame + dl * g.height;
+        for (int i = 0; i < h / 2; i++, uv += sl, dst += dl)
+            memcpy(dst, uv, bytes);
+    }
+
+    mCapture->post(frame);
+}
+
+void TestBase::bufferFilled(ANativeWindowBuffer *b, const char *bits, const char *uv)
+{
+    captureBuffer(bits, uv, b->stride, b->width, b->height);
+}
+
+// Capture reads back what was written to the buffer
+int TestBase::bufferUsage()
+{
+    if (mCapture != 0)
+        return GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+    return GRALLOC_USAGE;
+}
+
+// Bytes per pixel of dequeued buffers, NV12 counted as its luma plane
+int TestBase::bufferBpp()
+{
+    if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_NV12)
+        return 1;
+    if (mSpec->bufferFormat == HAL_PIXEL_FORMAT_TI_BGRX)
+        return 4;
+
+    int bpp = bytesPerPixel(mSpec->bufferFormat);
+    return bpp > 0 ? bpp : 4;
 }
 
 bool TestBase::lockNV12(sp<ANativeWindow> window, ANativeWindowBuffer **b, char **y, char **uv)
@@ -481,6 +990,7 @@ bool TestBase::lockNV12(sp<ANativeWindow> window, ANativeWindowBuffer **b, char
     d[0] = d[1] = 0;
 
     int res = 0;
+    mStat.startDequeue();
     res = w->dequeueBuffer(w, b);
     if (res != 0) {
         LOGE("\"%s\" dequeueBuffer failed", mSpec->name.c_str());
@@ -488,13 +998,14 @@ bool TestBase::lockNV12(sp<ANativeWindow> window, ANativeWindowBuffer **b, char
     }
 
     res = w->lockBuffer(w, *b);
+    mStat.doneDequeue();
     if (res != 0) {
         LOGE("\"%s\" lockBuffer failed", mSpec->name.c_str());
         w->cancelBuffer(w, *b);
         return false;
     }
 
-    res = mapper.lock((*b)->handle, GRALLOC_USAGE, bounds, d);
+    res = mapper.lock((*b)->handle, bufferUsage(), bounds, d);
     if (res != 0) {
         LOGE("\"%s\" mapper.lock failed", mSpec->name.c_str());
         w->cancelBuffer(w, *b);
@@ -517,6 +1028,45 @@ bool TestBase::lockNV12(sp<ANativeWindow> window, ANativeWindowBuffer **b, char
     return true;
 }
 
+bool TestBase::fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+        uint64_t& read, uint64_t& written)
+{
+    LOGE("\"%s\" content type can't be pipelined", mSpec->name.c_str());
+    return false;
+}
+
+// Filled buffers are handed over in order, waiting for one counts as dequeue wait
+void TestBase::postPipelined()
+{
+    uint64_t read = 0, written = 0;
+
+    mStat.startDequeue();
+    bool ok = mPipeline->post(read, written);
+    mStat.doneDequeue();
+    if (!ok) {
+        requestExit();
+        return;
+    }
+    accountBytes(read, written);
+}
+
+status_t TestBase::lockSurface(sp<Surface> surface, Surface::SurfaceInfo *info)
+{
+    mStat.startDequeue();
+    status_t res = surface->lock(info);
+    mStat.doneDequeue();
+    return res;
+}
+
+EGLBoolean TestBase::swapBuffers()
+{
+    mStat.doneDraw();
+    mStat.startDequeue();
+    EGLBoolean res = eglSwapBuffers(mEglDisplay, mEglSurface);
+    mStat.doneDequeue();
+    return res;
+}
+
 bool TestBase::updateContent(bool force)
 {
     UpdateParams p = mSpec->updateParams;
@@ -705,10 +1255,10 @@ bool TestBase::updateSize()
         int minVal = min(oh, lim.height());
         int maxVal = max(oh, lim.height());
 
-        mHeight += mHeightStepFactor * dw;
+        mHeight += mHeightStepFactor * dh;
         if (mHeight < minVal || mHeight > maxVal) {
             mHeightStepFactor *= -1;
-            mHeight += 2 * mHeightStepFactor * dw;
+            mHeight += 2 * mHeightStepFactor * dh;
         }
         mHeight = min(mHeight, maxVal);
         mHeight = max(mHeight, minVal);
@@ -718,6 +1268,56 @@ bool TestBase::updateSize()
     return changed;
 }
 
+// Keyframe tracks take over from the stepping of the same property. target
+// is when the frame is due, so animation speed doesn't depend on how late
+// iterations run.
+bool TestBase::animate(Keyframe::Track track, nsecs_t target)
+{
+    int a, b;
+    if (!mAnimation.evaluate(track, target - mAnimStart, a, b))
+        return false;
+
+    switch (track) {
+        case Keyframe::POSITION:
+            if (a == mLeft && b == mTop)
+                return false;
+            mLeft = a;
+            mTop = b;
+            return true;
+        case Keyframe::SIZE:
+            if (a <= 0 || b <= 0 || (a == mWidth && b == mHeight))
+                return false;
+            mWidth = a;
+            mHeight = b;
+            return true;
+        case Keyframe::ALPHA:
+            a = max(0, min(a, 255));
+            if (a == mAlpha)
+                return false;
+            mAlpha = a;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Grouped surfaces take turns on the group's context, switching to one is
+// part of what sharing costs
+bool TestBase::makeCurrent()
+{
+    if (eglGetCurrentSurface(EGL_DRAW) == mEglSurface)
+        return true;
+
+    nsecs_t start = systemTime();
+    if (eglMakeCurrent(mEglDisplay, mEglSurface, mEglSurface, mEglContext) == EGL_FALSE) {
+        LOGE("\"%s\" eglMakeCurrent failed", mSpec->name.c_str());
+        signalExit();
+        return false;
+    }
+    mStat.madeCurrent(ns2us(systemTime() - start));
+    return true;
+}
+
 void TestBase::signalExit()
 {
     requestExit();
@@ -727,83 +1327,232 @@ void TestBase::signalExit()
 }
 
 bool TestBase::threadLoop()
+{
+    beginUpdates();
+    while (iterate())
+        ;
+    endUpdates();
+    return false;
+}
+
+void TestBase::beginUpdates()
 {
     LOGD("\"%s\" starting", mSpec->name.c_str());
 
-    UpdateParams p = mSpec->updateParams;
-    const nsecs_t latency = p.latency;
+    mIteration = 0;
+
+    // Stagger surfaces that would otherwise update in lock step. A grouped
+    // surface can't sleep on the group's thread, its first due time moves.
+    unsigned int latencyPhase = mSpec->updateParams.latencyPhase;
+    if (latencyPhase > 0) {
+        if (mGlGroup != NULL) {
+            mLastIter = systemTime() + us2ns(latencyPhase);
+        } else {
+            usleep(latencyPhase);
+            mLastIter = systemTime();
+        }
+    }
+
+    mAnimation.build(mSpec->keyframes, mSpec->keyframeLoop);
+    mAnimStart = mLastIter;
+}
+
+// When the next iteration wants to run, for the group scheduling it
+nsecs_t TestBase::nextDue()
+{
+    Mutex::Autolock _l(mControlLock);
+    if (mPaused)
+        return mPausedAt == 0 ? 0 : systemTime() + ms2ns(PAUSE_POLL_MS);
+    if (mLatency == 0)
+        return 0;
+    return mLastIter + us2ns(mLatency);
+}
+
+// One pass of the update loop, false once it's over. A grouped surface
+// shares its thread, so it's only called when due and doesn't block while
+// paused, the group just passes it by.
+bool TestBase::iterate()
+{
+    const UpdateParams& p = mSpec->updateParams;
+    nsecs_t latency, target;
     int visibility;
-    bool positionChange, sizeChange;
+    bool positionChange, sizeChange, alphaChange;
+    Phase phase;
+
+    if ((mIteration >= p.iterations && p.iterations >= 0) || exitPending())
+        return false;
 
-    for (long int i = 0; (i < p.iterations || p.iterations < 0) && !exitPending(); i++) {
-        if (latency > 0) {
-            const nsecs_t sleepTime = latency - ns2us(systemTime() - mLastIter);
-            if (sleepTime > 0)
-                usleep (sleepTime);
+    {
+        Mutex::Autolock _l(mControlLock);
+        if (mPaused && mGlGroup != NULL) {
+            if (mPausedAt == 0) {
+                mPausedAt = systemTime();
+                LOGD("\"%s\" paused", mSpec->name.c_str());
+            }
+            return true;
+        } else if (mPaused) {
+            nsecs_t pausedAt = systemTime();
+            LOGD("\"%s\" paused", mSpec->name.c_str());
+            while (mPaused && !exitPending())
+                mControlCondition.wait(mControlLock);
+            LOGD("\"%s\" resumed", mSpec->name.c_str());
+            mLastIter = systemTime();
+            mAnimStart += mLastIter - pausedAt; // Animations pause too
+        } else if (mPausedAt != 0) {
+            LOGD("\"%s\" resumed", mSpec->name.c_str());
             mLastIter = systemTime();
+            mAnimStart += mLastIter - mPausedAt;
+            mPausedAt = 0;
         }
+        latency = mLatency;
+        phase = mPendingPhase;
+        mPendingPhase = Phase();
+    }
+
+    if (exitPending())
+        return false;
+
+    if (phase.fields != 0) {
+        // Keep stat intervals from straddling a phase change
+        publishStat();
+        if (!mSpec->renderFlag(RenderFlags::SILENT))
+            mStat.dump(mSpec->name);
+        mStat.clear();
+        phase.applyCycles(mSpec->updateParams);
+        LOGI("\"%s\" phase at %ums, latency %lldus", mSpec->name.c_str(), phase.time,
+                (long long)latency);
+    }
+
+    if (latency > 0) {
+        const nsecs_t sleepTime = latency - ns2us(systemTime() - mLastIter);
+        if (sleepTime > 0)
+            usleep (sleepTime);
+        target = mLastIter + us2ns(latency);
+        mLastIter = systemTime();
+    } else {
+        target = systemTime();
+    }
 
 #ifndef ADTF_ICS_AND_EARLIER
-        if (mEventReceiver) {
-            mEventLooper->pollOnce(-1);
-            while (mEventReceiver->getEvents(mEventBuffer, 100) > 0);
-            if (mEventReceiver->requestNextVsync() != NO_ERROR) {
-                LOGE("\"%s\" failed to request vsync", mSpec->name.c_str());
-                signalExit();
-                return false;
+    if (mEventReceiver) {
+        mEventLooper->pollOnce(-1);
+        ssize_t n;
+        while ((n = mEventReceiver->getEvents(mEventBuffer, 100)) > 0) {
+            for (ssize_t i = 0; i < n; i++) {
+                if (mEventBuffer[i].header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC)
+                    mPresent.vsync(mEventBuffer[i].header.timestamp);
             }
         }
+        if (mEventReceiver->requestNextVsync() != NO_ERROR) {
+            LOGE("\"%s\" failed to request vsync", mSpec->name.c_str());
+            return false;
+        }
+    }
 #endif
 
+    if (mAnimation.hasTrack(Keyframe::POSITION))
+        positionChange = animate(Keyframe::POSITION, target);
+    else
         positionChange = updatePosition();
+    if (mAnimation.hasTrack(Keyframe::SIZE))
+        sizeChange = animate(Keyframe::SIZE, target);
+    else
         sizeChange = updateSize();
-        visibility = getVisibility();
+    alphaChange = animate(Keyframe::ALPHA, target);
+    visibility = getVisibility();
 
-        if (positionChange || sizeChange || (visibility != 0)) {
-            SurfaceComposerClient::openGlobalTransaction();
-            mStat.openTransaction();
-
-            if (positionChange) {
-                mSurfaceControl->setPosition(mLeft, mTop);
-                mStat.setPosition();
-            }
+    if (positionChange || sizeChange || alphaChange || (visibility != 0)) {
+        SurfaceComposerClient::openGlobalTransaction();
+        mStat.openTransaction();
 
-            if (sizeChange) {
-                mSurfaceControl->setSize(mWidth, mHeight);
-                mStat.setSize();
-            }
+        if (positionChange) {
+            mSurfaceControl->setPosition(mLeft, mTop);
+            mStat.setPosition();
+        }
 
-            if (visibility < 0) {
-                mSurfaceControl->hide();
-                mStat.setVisibility();
-            }
-            else if (visibility > 0) {
-                mSurfaceControl->show();
-                mStat.setVisibility();
-            }
+        if (sizeChange) {
+            mSurfaceControl->setSize(mWidth, mHeight);
+            mStat.setSize();
+        }
 
-            SurfaceComposerClient::closeGlobalTransaction();
-            mStat.closeTransaction();
+        if (alphaChange) {
+            mSurfaceControl->setAlpha(mAlpha / 255.0f);
+            mStat.setAlpha();
         }
 
-        if (updateContent(sizeChange)) {
-            mStat.startUpdate();
-            updateContent();
-            mStat.doneUpdate();
-            mLastWidth = mWidth;
-            mLastHeight = mHeight;
+        if (visibility < 0) {
+            mSurfaceControl->hide();
+            mStat.setVisibility();
         }
-        if (mStat.sinceClear() >= 1000000) {
-            if (!mSpec->renderFlag(RenderFlags::SILENT))
-                mStat.dump(mSpec->name);
-            mStat.clear();
+        else if (visibility > 0) {
+            mSurfaceControl->show();
+            mStat.setVisibility();
         }
+
+        SurfaceComposerClient::closeGlobalTransaction();
+        mStat.closeTransaction();
+    }
+
+    if (updateContent(sizeChange)) {
+        if (mGlGroup != NULL && !makeCurrent())
+            return false;
+        mPresent.beginFrame();
+        mStat.startUpdate();
+        if (mPipeline != 0)
+            postPipelined();
+        else
+            updateContent();
+        mStat.doneUpdate();
+        mPresent.queued(systemTime(), sampleQueue());
+        mLastWidth = mWidth;
+        mLastHeight = mHeight;
+    }
+
+    mPresent.collect(mStat);
+    if (mVerifier != 0)
+        mVerifier->collect(mStat);
+    if (mCapture != 0)
+        mCapture->collect(mStat);
+    if (mUnderruns > 0)
+        mStat.addUnderruns(__sync_lock_test_and_set(&mUnderruns, 0));
+
+    // With a latency each iteration should be done before the next is due
+    if (latency > 0)
+        mStat.frameDone(ns2us(systemTime() - mLastIter) > latency);
+
+    if (mStat.sinceClear() >= 1000000) {
+        publishStat();
+        if (!mSpec->renderFlag(RenderFlags::SILENT))
+            mStat.dump(mSpec->name);
+        mStat.clear();
+    }
+
+    mIteration++;
+    return true;
+}
+
+void TestBase::endUpdates()
+{
+    if (mPipeline != 0) {
+        mPipeline->stop();
+        LOGD("\"%s\" pipeline producer waited %lldus for buffers", mSpec->name.c_str(),
+                (long long)mPipeline->producerWait());
+    }
+
+    // Frames still being checksummed belong in the last interval
+    if (mVerifier != 0) {
+        mVerifier->stop();
+        mVerifier->collect(mStat);
+    }
+    if (mCapture != 0) {
+        mCapture->stop();
+        mCapture->collect(mStat);
     }
 
     mStat.dump(mSpec->name);
+    mStat.clear(); // Adds the last interval to the process total
 
     LOGD("\"%s\" thread exiting", mSpec->name.c_str());
 
-    signalExit();
-    return false;
+    loopDone();
 }
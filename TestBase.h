@@ -43,15 +43,24 @@
 #include <GLES/gl.h>
 #include <GLES/glext.h>
 
+#include "Animation.h"
+#include "BufferPipeline.h"
+#include "CaptureWriter.h"
+#include "EglCache.h"
+#include "FrameVerifier.h"
 #include "LocalTypes.h"
+#include "PresentTracker.h"
 #include "Stat.h"
+#include "StartupGate.h"
 
 #define GRALLOC_USAGE       GRALLOC_USAGE_SW_READ_NEVER | \
                             GRALLOC_USAGE_SW_WRITE_OFTEN
 
 using namespace android;
 
-class TestBase : public Thread {
+class GlGroup;
+
+class TestBase : public Thread, public BufferPipeline::Filler {
     public:
         TestBase(sp<SurfaceSpec> spec, sp<SurfaceComposerClient> client,
                 Mutex &exitLock, Condition &exitCondition);
@@ -61,17 +70,79 @@ class TestBase : public Thread {
         bool done();
         virtual status_t readyToRun();
 
+        // Bring-up takes a slot of gate, barrier to also wait for the
+        // surfaces starting together before the first iteration
+        void setStartupGate(StartupGate *gate, bool barrier);
+        const StartupTimes& startupTimes();
+        // Measure from now, for surfaces that start together
+        void resetStart();
+
+        // Render on group's thread and context instead of a thread of our
+        // own, set before the group runs
+        void setGlGroup(GlGroup *group);
+        GlGroup *glGroup();
+
+        // The update loop in steps, a group interleaves its surfaces' with
+        // nextDue() telling it when each wants to run again
+        void beginUpdates();
+        bool iterate();
+        nsecs_t nextDue();
+        void endUpdates();
+
+        // Grouped surfaces are done when the group says so rather than when
+        // a thread of their own exits
+        void enterGroup();
+        void loopDone();
+        void waitExit();
+
+        // Run time control, may be called from any thread
+        void pause();
+        void resume();
+        void stop();
+        void setLatency(unsigned int latency);
+        void applyPhase(const Phase& phase);
+        bool paused();
+        std::string snapshot();
+        std::string histograms();
+
+        // Only valid once the thread has exited
+        void getFrameCounts(uint64_t& frames, uint64_t& misses);
+
     protected:
+        // Everything up to and including the first frame, subclasses end
+        // theirs with TestBase::prepare()
+        virtual status_t prepare();
         virtual void updateContent() = 0;
         virtual void createSurface();
         void initEgl();
         bool purgeEglBuffers();
         void freeEgl();
         virtual void chooseEGLConfig(EGLDisplay display, EGLConfig *config);
+        // What chooseEGLConfig's choice depends on, for EglCache
+        virtual std::string configKey();
         virtual EGLContext createEGLContext(EGLDisplay display, EGLConfig config);
+        // From the GLES2 render flag
+        int glesVersion();
 
         void signalExit();
+        void accountBytes(uint64_t read, uint64_t written);
+        void accountUnderrun();
+        void verifyFrame(uint64_t index, const void *data, size_t len, bool stable);
+        void captureBuffer(const char *bits, const char *uv, int stride, int width, int height);
+        int bufferUsage();
+        int bufferBpp();
         bool lockNV12(sp<ANativeWindow> window, ANativeWindowBuffer **b, char **y, char **uv);
+        bool makeCurrent();
+
+        // Calls that may block on a free buffer, timed as dequeue wait. A GL
+        // swap includes dequeueing the next buffer.
+        status_t lockSurface(sp<Surface> surface, Surface::SurfaceInfo *info);
+        EGLBoolean swapBuffers();
+
+        // Pipelined CPU content (pipeline_depth), runs on the pipeline thread
+        virtual bool fillBuffer(ANativeWindowBuffer *b, char *bits, char *uv,
+                uint64_t& read, uint64_t& written);
+        virtual void bufferFilled(ANativeWindowBuffer *b, const char *bits, const char *uv);
 
         sp<SurfaceSpec> mSpec;
 
@@ -87,9 +158,19 @@ class TestBase : public Thread {
 
 
     private:
+        enum { PAUSE_POLL_MS = 10 };    // How often a group checks on a paused surface
+
+        void configureBuffers();
+        void applyScheduling();
+        void initEglSurface(EGLConfig config, nsecs_t start);
+        bool sampleQueue();
+        nsecs_t vsyncPeriod();
+        void postPipelined();
+        void publishStat();
         int getVisibility();
         bool updatePosition();
         bool updateSize();
+        bool animate(Keyframe::Track track, nsecs_t target);
         bool updateContent(bool force);
         bool threadLoop();
 
@@ -111,9 +192,37 @@ class TestBase : public Thread {
         int mTopStepFactor;
         int mWidthStepFactor;
         int mHeightStepFactor;
+        int mAlpha;
+
+        Animation mAnimation;
+        nsecs_t mAnimStart;
+
+        StartupGate *mGate;
+        bool mBarrier;
+        StartupTimes mStartup;
+
+        GlGroup *mGlGroup;
+        bool mOwnsContext;      // Grouped surfaces borrow the group's
+        bool mGrouped;
+        bool mLoopDone;
+        long int mIteration;
+        nsecs_t mPausedAt;      // Grouped surfaces pause without blocking
 
         nsecs_t mLastIter;
         Stat mStat;
+        PresentTracker mPresent;
+        sp<BufferPipeline> mPipeline;
+        sp<FrameVerifier> mVerifier;
+        sp<CaptureWriter> mCapture;
+        volatile int32_t mUnderruns;    // From any thread, moved to mStat per iteration
+
+        Mutex mControlLock;
+        Condition mControlCondition;
+        bool mPaused;
+        unsigned int mLatency;
+        Phase mPendingPhase;    // Duty cycles for the update thread to pick up
+        std::string mSnapshot;
+        std::string mHistSnapshot;
 
 #ifndef ADTF_ICS_AND_EARLIER
         DisplayEventReceiver *mEventReceiver;
@@ -32,13 +32,33 @@
 
 #define LOG_TAG "adtf"
 
+#include <algorithm>
+#include <sstream>
+
 #include "ThreadManager.h"
 
 using namespace android;
+using namespace std;
 
 ThreadManager::ThreadManager(List<sp<SurfaceSpec> >& specs)
-    : Thread(false), mSpecs(specs)
+    : Thread(false), mSpecs(specs), mFrames(0), mMisses(0), mDuration(0),
+    mGroup(NULL), mStartupSlots(0)
+{
+}
+
+void ThreadManager::setControlSocket(string name)
 {
+    mControlName = name;
+}
+
+void ThreadManager::setProcessGroup(ProcessGroup *group)
+{
+    mGroup = group;
+}
+
+void ThreadManager::setStartupSlots(unsigned int slots)
+{
+    mStartupSlots = slots;
 }
 
 status_t ThreadManager::readyToRun()
@@ -48,6 +68,9 @@ status_t ThreadManager::readyToRun()
     mLock.lock();
 
     mThreads.clear();
+    mTimeline.clear();
+    mGlGroups.clear();
+    unsigned int together = 0;
     for (List<sp<SurfaceSpec> >::iterator it = mSpecs.begin(); it != mSpecs.end(); ++it) {
         sp<SurfaceSpec> spec = *it;
         sp<TestBase> thread;
@@ -58,34 +81,219 @@ status_t ThreadManager::readyToRun()
         else if (spec->contentType == ContentType::PLUGIN)
             thread = sp<TestBase>(new PluginThread(spec, composerClient, mLock, mCondition));
 
+        if (spec->stopTime != 0 && spec->stopTime <= spec->startDelay) {
+            LOGW("\"%s\" stop_time %u not after start_delay %u, skipped", spec->name.c_str(),
+                    spec->stopTime, spec->startDelay);
+            continue;
+        }
+
         mThreads.push_back(thread);
+
+        // A group's surfaces take gate slots but reach the barrier through
+        // the group
+        sp<GlGroup> group;
+        if (!spec->glGroup.empty()) {
+            if (!spec->renderFlag(RenderFlags::GL))
+                LOGW("\"%s\" gl_group without GL rendering, ignored", spec->name.c_str());
+            else if (spec->contentType == ContentType::PLUGIN ||
+                    spec->renderFlag(RenderFlags::VSYNC))
+                LOGW("\"%s\" plugins and vsync surfaces can't share a thread, "
+                        "gl_group ignored", spec->name.c_str());
+            else
+                group = findGlGroup(spec->glGroup);
+        }
+
+        // Those starting with the run share its start, later ones join a
+        // run already under way
+        if (group != 0) {
+            group->assign(thread, spec->startDelay == 0);
+            thread->setStartupGate(&mStartup, false);
+        } else {
+            thread->setStartupGate(&mStartup, spec->startDelay == 0);
+            if (spec->startDelay == 0)
+                together++;
+        }
+
+        Phase none;
+        addEvent(ms2ns(spec->startDelay), TimelineEvent::START, thread, none);
+        for (List<Phase>::iterator ph = spec->phases.begin(); ph != spec->phases.end(); ++ph)
+            addEvent(ms2ns(ph->time), TimelineEvent::PHASE, thread, *ph);
+        if (spec->stopTime != 0)
+            addEvent(ms2ns(spec->stopTime), TimelineEvent::STOP, thread, none);
+    }
+
+    for (List<sp<GlGroup> >::iterator it = mGlGroups.begin(); it != mGlGroups.end(); ++it) {
+        sp<GlGroup> group = *it;
+        group->setStartupGate(&mStartup, group->hasInitial());
+        if (group->hasInitial())
+            together++;
     }
 
+    // Starts before phases before stops at the same time, otherwise in spec order
+    stable_sort(mTimeline.begin(), mTimeline.end(), earlier);
+
+    // Worker processes line up before their surfaces start updating
+    mStartup.init(mStartupSlots, together, mGroup != NULL);
+
     mLock.unlock();
 
     return NO_ERROR;
 }
 
+sp<GlGroup> ThreadManager::findGlGroup(const string& name)
+{
+    for (List<sp<GlGroup> >::iterator it = mGlGroups.begin(); it != mGlGroups.end(); ++it) {
+        if ((*it)->name() == name)
+            return *it;
+    }
+
+    sp<GlGroup> group = new GlGroup(name);
+    mGlGroups.push_back(group);
+    return group;
+}
+
+bool ThreadManager::earlier(const TimelineEvent& a, const TimelineEvent& b)
+{
+    if (a.time != b.time)
+        return a.time < b.time;
+    return a.type < b.type;
+}
+
+void ThreadManager::addEvent(nsecs_t time, TimelineEvent::Type type, sp<TestBase> thread,
+        const Phase& phase)
+{
+    TimelineEvent e;
+    e.time = time;
+    e.type = type;
+    e.thread = thread;
+    e.phase = phase;
+    mTimeline.push_back(e);
+}
+
+// Called with mLock held
+void ThreadManager::fireEvent(const TimelineEvent& e)
+{
+    if (e.thread == 0)
+        return; // Already exited
+
+    const char *name = e.thread->getSpec()->name.c_str();
+    GlGroup *group = e.thread->glGroup();
+
+    switch (e.type) {
+        case TimelineEvent::START:
+            // Stopped from the control socket before it was due
+            if (e.thread->done()) {
+                if (e.time == 0 && group == NULL)
+                    mStartup.leave();
+                break;
+            }
+            LOGD("\"%s\" starting at %lldms", name, (long long)ns2ms(e.time));
+            if (group != NULL) {
+                // Every member it had has retired, this one comes too late.
+                // Stopped, it's reaped like one stopped before its start.
+                if (group->hasStarted() && !group->isRunning()) {
+                    LOGW("group \"%s\" has finished, \"%s\" not started",
+                            group->name().c_str(), name);
+                    e.thread->stop();
+                    break;
+                }
+                // Only a group of late surfaces hasn't started yet
+                if (!group->hasStarted() && group->start() != NO_ERROR) {
+                    LOGW("group \"%s\" failed to run, \"%s\" runs alone",
+                            group->name().c_str(), name);
+                    e.thread->setGlGroup(NULL);
+                } else {
+                    group->add(e.thread);
+                    break;
+                }
+            }
+            if (e.thread->run() != NO_ERROR && e.time == 0)
+                mStartup.leave();
+            break;
+        case TimelineEvent::PHASE:
+            LOGD("\"%s\" phase at %lldms", name, (long long)ns2ms(e.time));
+            e.thread->applyPhase(e.phase);
+            break;
+        case TimelineEvent::STOP:
+            LOGD("\"%s\" stopping at %lldms", name, (long long)ns2ms(e.time));
+            e.thread->stop();
+            break;
+    }
+}
+
 bool ThreadManager::threadLoop()
 {
+    nsecs_t start = systemTime();
+
+    // Saturation runs one manager per step in the same process
+    Stat::resetTotals();
+
+    if (!mControlName.empty()) {
+        mControl = new ControlSocket(mControlName, this);
+        if (mControl->run() != NO_ERROR)
+            mControl.clear();
+    }
+
+    // Groups with surfaces starting with the run bring them up right away
+    for (List<sp<GlGroup> >::iterator it = mGlGroups.begin(); it != mGlGroups.end(); ++it) {
+        sp<GlGroup> group = *it;
+        if (group->hasInitial() && group->start() != NO_ERROR) {
+            LOGE("group \"%s\" failed to run", group->name().c_str());
+            group->abandon();
+            mStartup.leave();
+        }
+    }
+
     mLock.lock();
 
-    for (List<sp<TestBase> >::iterator it = mThreads.begin(); it != mThreads.end(); ++it) {
-        sp<TestBase> thread = *it;
-        thread->run();
+    size_t next = 0;
+    if (mGroup != NULL) {
+        // Bring up the surfaces starting with the run, then hold them at
+        // the gate until the other workers have theirs up too, so that
+        // every process starts updating, and its timeline, at one time
+        while (next < mTimeline.size() && mTimeline[next].time == 0)
+            fireEvent(mTimeline[next++]);
+        mLock.unlock();
+        mStartup.waitArrived();
+        start = mGroup->waitStart();
+        mStartup.unhold();
+        mLock.lock();
     }
 
     while (mThreads.size() > 0) {
-        LOGD("waiting for %i threads", mThreads.size());
-        mCondition.wait(mLock);
+        nsecs_t now = systemTime() - start;
+        while (next < mTimeline.size() && mTimeline[next].time <= now)
+            fireEvent(mTimeline[next++]);
+
+        // Thread exits wake us up early. Ones stopped at their start never
+        // ran and won't, reap them right away.
+        bool stopped = false;
+        for (List<sp<TestBase> >::iterator it = mThreads.begin(); it != mThreads.end(); ++it)
+            stopped = stopped || (*it)->done();
+        if (!stopped && next < mTimeline.size()) {
+            mCondition.waitRelative(mLock, mTimeline[next].time - now);
+        } else if (!stopped) {
+            LOGD("waiting for %i threads", mThreads.size());
+            mCondition.wait(mLock);
+        }
+
         List<sp<TestBase> >::iterator it = mThreads.begin();
         while (it != mThreads.end()) {
             sp<TestBase> thread = *it;
             if (thread->done()) {
                 mThreads.erase(it);
+                // Pending events must not keep it (and its surface) around
+                for (size_t i = 0; i < mTimeline.size(); i++) {
+                    if (mTimeline[i].thread == thread)
+                        mTimeline[i].thread.clear();
+                }
                 mLock.unlock();
-                thread->join();
+                thread->waitExit();
                 mLock.lock();
+                uint64_t frames, misses;
+                thread->getFrameCounts(frames, misses);
+                mFrames += frames;
+                mMisses += misses;
                 it = mThreads.begin();
                 LOGD("\"%s\" thread exited, keepAlive %d",
                         thread->getSpec()->name.c_str(),
@@ -100,9 +308,102 @@ bool ThreadManager::threadLoop()
 
     mLock.unlock();
 
+    if (mControl != 0) {
+        mControl->requestExit();
+        mControl->join();
+        mControl.clear();
+    }
+
+    for (List<sp<GlGroup> >::iterator it = mGlGroups.begin(); it != mGlGroups.end(); ++it)
+        (*it)->join();
+    mGlGroups.clear();
+
     mGhosts.clear();
+    mTimeline.clear();
 
     LOGD("all threads terminated");
 
+    mLock.lock();
+    mDuration = systemTime() - start;
+    mLock.unlock();
+
+    Stat::dumpTotal(ns2us(mDuration));
+
     return false;
 }
+
+void ThreadManager::getFrameCounts(uint64_t& frames, uint64_t& misses)
+{
+    Mutex::Autolock _l(mLock);
+    frames = mFrames;
+    misses = mMisses;
+}
+
+nsecs_t ThreadManager::getDuration()
+{
+    Mutex::Autolock _l(mLock);
+    return mDuration;
+}
+
+string ThreadManager::control(const string& line)
+{
+    stringstream in(line), out;
+    string cmd, target;
+    unsigned int latency = 0;
+
+    in >> cmd >> target;
+
+    if (cmd == "help") {
+        out << "stats [name|all]           last interval stat per surface\n";
+        out << "hist [name|all]            update time histogram per surface\n";
+        out << "pause [name|all]           stop updating until resumed\n";
+        out << "resume [name|all]          continue updating\n";
+        out << "latency <name|all> <us>    change update_latency\n";
+        out << "stop [name|all]            end the surface update threads\n";
+        out << "ok\n";
+        return out.str();
+    }
+
+    if (cmd == "latency") {
+        in >> latency;
+        if (in.fail() || target.empty())
+            return "error: usage 'latency <name|all> <us>'\n";
+    } else if (cmd != "stats" && cmd != "hist" && cmd != "pause" &&
+            cmd != "resume" && cmd != "stop") {
+        return "error: unknown command '" + cmd + "', try 'help'\n";
+    }
+
+    Mutex::Autolock _l(mLock);
+
+    int matched = 0;
+    for (List<sp<TestBase> >::iterator it = mThreads.begin(); it != mThreads.end(); ++it) {
+        sp<TestBase> thread = *it;
+        const string& name = thread->getSpec()->name;
+
+        if (!target.empty() && target != "all" && target != name)
+            continue;
+        matched++;
+
+        if (cmd == "stats") {
+            out << "\"" << name << "\"" << (thread->paused() ? " paused" : "")
+                << thread->snapshot() << "\n";
+        } else if (cmd == "hist") {
+            out << "\"" << name << "\" " << thread->histograms() << "\n";
+        } else if (cmd == "pause") {
+            thread->pause();
+        } else if (cmd == "resume") {
+            thread->resume();
+        } else if (cmd == "latency") {
+            thread->setLatency(latency);
+        } else if (cmd == "stop") {
+            thread->stop();
+        }
+    }
+
+    if (matched == 0)
+        return "error: no running surface '" + target + "'\n";
+
+    LOGD("control '%s' applied to %d surfaces", line.c_str(), matched);
+    out << "ok\n";
+    return out.str();
+}
@@ -30,9 +30,18 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef _THREAD_MANAGER_H
+#define _THREAD_MANAGER_H
+
+#include <string>
+#include <vector>
+
+#include "ControlSocket.h"
 #include "FileThread.h"
+#include "GlGroup.h"
 #include "SolidThread.h"
 #include "PluginThread.h"
+#include "ProcessGroup.h"
 
 using namespace android;
 
@@ -40,9 +49,36 @@ class ThreadManager : public Thread {
     public:
         ThreadManager(List<sp<SurfaceSpec> >& specs);
 
+        void setControlSocket(std::string name);
+        // Holds the start until every worker of the group is ready
+        void setProcessGroup(ProcessGroup *group);
+        // Surfaces brought up at once, 0 for one per CPU
+        void setStartupSlots(unsigned int slots);
         status_t readyToRun();
 
+        // Handles one command line from the control socket, returns the reply
+        std::string control(const std::string& line);
+
+        // Sum over all surfaces, valid once the manager has been joined
+        void getFrameCounts(uint64_t& frames, uint64_t& misses);
+        nsecs_t getDuration();
+
     private:
+        // A scheduled change to one surface thread
+        struct TimelineEvent {
+            enum Type { START, PHASE, STOP };
+
+            nsecs_t time;   // After the run started
+            Type type;
+            sp<TestBase> thread;
+            Phase phase;
+        };
+
+        static bool earlier(const TimelineEvent& a, const TimelineEvent& b);
+        void addEvent(nsecs_t time, TimelineEvent::Type type, sp<TestBase> thread,
+                const Phase& phase);
+        void fireEvent(const TimelineEvent& e);
+        sp<GlGroup> findGlGroup(const std::string& name);
         bool threadLoop();
 
         Mutex mLock;
@@ -51,4 +87,19 @@ class ThreadManager : public Thread {
         List<sp<SurfaceSpec> > mSpecs;
         List<sp<TestBase> > mThreads;
         List<sp<TestBase> > mGhosts;
+        List<sp<GlGroup> > mGlGroups;
+        std::vector<TimelineEvent> mTimeline; // In time order
+
+        uint64_t mFrames;
+        uint64_t mMisses;
+        nsecs_t mDuration;
+
+        ProcessGroup *mGroup;
+        StartupGate mStartup;
+        unsigned int mStartupSlots;
+
+        std::string mControlName;
+        sp<ControlSocket> mControl;
 };
+
+#endif
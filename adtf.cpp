@@ -33,6 +33,10 @@
 #define LOG_TAG "adtf"
 
 #include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <binder/ProcessState.h>
 
@@ -41,6 +45,13 @@
 # include <sys/resource.h>
 #endif
 
+#include "FileThread.h"
+#include "FrameCodec.h"
+#include "Histogram.h"
+#include "ProcessGroup.h"
+#include "RefCompositor.h"
+#include "Saturation.h"
+#include "SpecCache.h"
 #include "ThreadManager.h"
 #include "SpecParser.h"
 
@@ -49,28 +60,265 @@
 using namespace android;
 using namespace std;
 
-void run(List<sp<SurfaceSpec> >& specs)
+static void usage(const char *name)
+{
+#ifdef VERSION
+    cout << "Version " << VERSION << endl;
+#endif
+    cout << "Usage: " << name << " [options] path_to_test_spec1 path_to_test_spec2 (...)" << endl;
+    cout << "  -c <socket>  accept commands on a UNIX-domain socket, '@name' for" << endl;
+    cout << "               the abstract namespace. Send 'help' for a command list" << endl;
+    cout << "  -r <mode>    saturation search using the first surface as template." << endl;
+    cout << "               mode is 'surfaces', 'latency' or 'size'" << endl;
+    cout << "  -t <pct>     saturation deadline miss threshold, default 1.0" << endl;
+    cout << "  -n <steps>   saturation step limit, default 32" << endl;
+    cout << "  -g <step>    surfaces added, or latency/size percent per step, default" << endl;
+    cout << "               1 surface or 10 percent" << endl;
+    cout << "  -b <passes>  parse the case files repeatedly, report parse time and exit" << endl;
+    cout << "  -k <dir>     cache parsed case files in dir, reparsed when they change" << endl;
+    cout << "  -e <bands>   encode the clip of every file surface to <clip>.adtc in" << endl;
+    cout << "               bands decoded in parallel, and exit" << endl;
+    cout << "  -x <frames>  compose frames with the software reference compositor, no" << endl;
+    cout << "               display needed, report composition times and exit" << endl;
+    cout << "  -w <file>    with -x, write the last composed frame to file as raw RGBA" << endl;
+    cout << "  -j <slots>   surfaces brought up at once at the start, default one" << endl;
+    cout << "               per CPU. All of them start updating together" << endl;
+    cout << "  -P <procs>   spread the surfaces round robin over worker processes," << endl;
+    cout << "               each with its own composer connection, started together." << endl;
+    cout << "               Worker n listens on <socket>.n with -c" << endl;
+}
+
+static bool loadSpecs(const char *filename, const string& cacheDir,
+        List<sp<SurfaceSpec> >& specs)
+{
+    if (cacheDir.empty())
+        return SpecParser::parseFile(filename, specs);
+    return SpecCache::load(cacheDir, filename, specs);
+}
+
+// Parse every case file passes times and report the cost per pass and per
+// surface, to keep parsing out of the way of large generated case files
+static int benchmarkParse(int argc, char **argv, int first, int passes,
+        const string& cacheDir)
+{
+    size_t surfaces = 0;
+    nsecs_t start = systemTime();
+
+    for (int pass = 0; pass < passes; pass++) {
+        List<sp<SurfaceSpec> > specs;
+        for (int i = first; i < argc; i++) {
+            if (!loadSpecs(argv[i], cacheDir, specs)) {
+                cout << "parsing of '" << argv[i] << "' failed" << endl;
+                return -1;
+            }
+        }
+        surfaces = specs.size();
+    }
+
+    nsecs_t perPass = (systemTime() - start) / passes;
+    cout << "parsed " << surfaces << " surfaces from " << argc - first << " files in "
+        << ns2us(perPass) << "us per pass";
+    if (surfaces > 0)
+        cout << ", " << perPass / surfaces << "ns per surface";
+    cout << " (" << passes << " passes)" << endl;
+    LOGI("parse benchmark: %d surfaces, %lld us per pass", (int)surfaces,
+            (long long)ns2us(perPass));
+
+    return 0;
+}
+
+// Encode each file surface's clip with the geometry and format of the
+// surface, which the coded clip has to be played back with
+static int encodeClips(List<sp<SurfaceSpec> >& specs, unsigned int bands)
+{
+    int encoded = 0;
+
+    for (List<sp<SurfaceSpec> >::iterator it = specs.begin(); it != specs.end(); it++) {
+        sp<SurfaceSpec> spec = *it;
+        if (spec->contentType != ContentType::FILE)
+            continue;
+
+        string clip;
+        stringstream ss(spec->content);
+        ss >> clip;
+        if (FrameCodec::isCoded(clip))
+            continue;
+
+        string out = clip + ".adtc";
+        nsecs_t start = systemTime();
+        if (!FrameCodec::encode(clip, out, FileThread::frameSize(spec), bands)) {
+            cout << "encoding of '" << clip << "' failed" << endl;
+            return -1;
+        }
+        nsecs_t elapsed = systemTime() - start;
+
+        struct stat in, coded;
+        stat(clip.c_str(), &in);
+        stat(out.c_str(), &coded);
+        cout << "encoded '" << clip << "' to '" << out << "', " << in.st_size << " -> "
+            << coded.st_size << " bytes in " << ns2ms(elapsed) << "ms" << endl;
+        encoded++;
+    }
+
+    if (encoded == 0)
+        cout << "no file content to encode" << endl;
+    return 0;
+}
+
+// Compose the case in software, sized to cover every surface's output rect
+static int composeHeadless(List<sp<SurfaceSpec> >& specs, int frames, const string& out)
+{
+    int width = 1, height = 1;
+    for (List<sp<SurfaceSpec> >::iterator it = specs.begin(); it != specs.end(); it++) {
+        const sp<SurfaceSpec>& s = *it;
+        width = max(width, s->outRect.width() > 0 ? s->outRect.right :
+                s->outRect.left + s->srcGeometry.width);
+        height = max(height, s->outRect.height() > 0 ? s->outRect.bottom :
+                s->outRect.top + s->srcGeometry.height);
+    }
+
+    RefCompositor compositor(width, height, 0);
+    for (List<sp<SurfaceSpec> >::iterator it = specs.begin(); it != specs.end(); it++) {
+        if (!compositor.addSurface(*it)) {
+            cout << "\"" << (*it)->name << "\" can't be composed" << endl;
+            return -1;
+        }
+    }
+
+    Histogram hist;
+    for (int i = 0; i < frames; i++) {
+        nsecs_t t = compositor.compose();
+        LOGD("composed frame %d in %lldus", i, (long long)ns2us(t));
+        hist.add(ns2us(t));
+    }
+
+    cout << "composed " << frames << " frames of " << width << "x" << height << " from "
+        << specs.size() << " surfaces, us per frame avg/min/max " << hist.avg() << "/"
+        << hist.min() << "/" << hist.max() << ", 50/90/99% below " << hist.percentile(50)
+        << "/" << hist.percentile(90) << "/" << hist.percentile(99) << endl;
+    cout << "  " << hist.toString() << endl;
+
+    if (!out.empty()) {
+        if (!compositor.writeFrame(out))
+            return -1;
+        cout << "wrote last frame to '" << out << "'" << endl;
+    }
+    return 0;
+}
+
+void run(List<sp<SurfaceSpec> >& specs, string control, unsigned int startupSlots,
+        ProcessGroup *group)
 {
     sp<ThreadManager> mgr(new ThreadManager(specs));
+    mgr->setControlSocket(control);
+    mgr->setStartupSlots(startupSlots);
+    mgr->setProcessGroup(group);
     mgr->run();
     mgr->join(); // Won't return until all update threads have terminated
+
+    if (group != NULL) {
+        uint64_t frames, misses;
+        mgr->getFrameCounts(frames, misses);
+        group->report(frames, misses, Stat::getTotals(), mgr->getDuration());
+    }
 }
 
 int main (int argc, char** argv)
 {
-    if (argc < 2) {
-#ifdef VERSION
-        cout << "Version " << VERSION << endl;
-#endif
-        cout << "Usage: " << argv[0] << " path_to_test_spec1 path_to_test_spec2 (...)" << endl;
+    string control, cacheDir;
+    bool saturate = false;
+    Saturation::Mode mode = Saturation::SURFACES;
+    double threshold = 1.0;
+    int steps = 32, stepSize = -1;
+    int benchmarkPasses = 0;
+    int encodeBands = 0;
+    int composeFrames = 0;
+    string composeOut;
+    int procs = 1;
+    int startupSlots = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:t:n:g:b:k:e:x:w:j:P:")) != -1) {
+        switch (opt) {
+            case 'c':
+                control = optarg;
+                break;
+            case 'r':
+                saturate = true;
+                if (!Saturation::parseMode(optarg, &mode)) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'n':
+                steps = atoi(optarg);
+                break;
+            case 'g':
+                stepSize = atoi(optarg);
+                break;
+            case 'b':
+                benchmarkPasses = atoi(optarg);
+                if (benchmarkPasses <= 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'k':
+                cacheDir = optarg;
+                break;
+            case 'e':
+                encodeBands = atoi(optarg);
+                if (encodeBands <= 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'x':
+                composeFrames = atoi(optarg);
+                if (composeFrames <= 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'w':
+                composeOut = optarg;
+                break;
+            case 'j':
+                startupSlots = atoi(optarg);
+                if (startupSlots <= 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'P':
+                procs = atoi(optarg);
+                if (procs <= 0) {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
         return -1;
     }
 
+    if (benchmarkPasses > 0)
+        return benchmarkParse(argc, argv, optind, benchmarkPasses, cacheDir);
+
     LOGD(" ");
 
     List<sp<SurfaceSpec> > specs;
-    for (int i = 1; i < argc; i++) {
-        if (!SpecParser::parseFile(argv[i], specs)) {
+    for (int i = optind; i < argc; i++) {
+        if (!loadSpecs(argv[i], cacheDir, specs)) {
             LOGW("parsing of '%s' failed", argv[i]);
             cout << "parsing of '" << argv[i] << "' failed" << endl;
         }
@@ -82,15 +330,69 @@ int main (int argc, char** argv)
         return -1;
     }
 
+    if (encodeBands > 0)
+        return encodeClips(specs, encodeBands);
+    if (composeFrames > 0)
+        return composeHeadless(specs, composeFrames, composeOut);
+
 #if defined(HAVE_PTHREADS)
     setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_DISPLAY);
 #endif
 
+    if (procs > 1 && saturate) {
+        LOGW("saturation search runs in one process, -P ignored");
+        procs = 1;
+    }
+    if (procs > (int)specs.size())
+        procs = specs.size();
+
+    // Fork before the binder is opened, each worker opens its own
+    ProcessGroup group(procs);
+    if (procs > 1) {
+        if (!group.spawn()) {
+            cout << "unable to start " << procs << " worker processes" << endl;
+            return -1;
+        }
+        if (!group.isWorker()) {
+            LOGD("running in %d workers", procs);
+            bool ok = group.wait();
+            LOGD("done");
+            return ok ? 0 : -1;
+        }
+
+        List<sp<SurfaceSpec> > share;
+        int i = 0;
+        for (List<sp<SurfaceSpec> >::iterator it = specs.begin(); it != specs.end(); it++) {
+            if (i++ % procs == group.index())
+                share.push_back(*it);
+        }
+        specs = share;
+
+        if (!control.empty()) {
+            stringstream name;
+            name << control << "." << group.index();
+            control = name.str();
+        }
+    }
+
     sp<ProcessState> proc(ProcessState::self());
     ProcessState::self()->startThreadPool();
 
+    if (saturate) {
+        if (specs.size() > 1)
+            LOGW("saturation search uses only the first surface as template");
+        if (stepSize < 0)
+            stepSize = mode == Saturation::SURFACES ? 1 : 10;
+
+        Saturation search(*specs.begin(), mode, threshold, steps, stepSize);
+        LOGD("running saturation search");
+        bool ok = search.run();
+        LOGD("done");
+        return ok ? 0 : -1;
+    }
+
     LOGD("running");
-    run(specs);
+    run(specs, control, startupSlots, procs > 1 ? &group : NULL);
     LOGD("done");
 
     return 0;
@@ -47,12 +47,17 @@ LOCAL_SHARED_LIBRARIES := \
     libEGL \
     libGLESv1_CM \
     libui \
+    libstlport \
     libdl \
 
 LOCAL_MODULE:= adtf_plugin
 
+LOCAL_C_INCLUDES := \
+    bionic \
+    external/stlport/stlport \
+
 ifeq ($(is_jb_or_later),1)
-LOCAL_C_INCLUDES := $(call include-path-for, opengl-tests-includes)
+LOCAL_C_INCLUDES += $(call include-path-for, opengl-tests-includes)
 else
 LOCAL_CFLAGS := -DADTF_ICS_AND_EARLIER
 endif
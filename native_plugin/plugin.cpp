@@ -34,6 +34,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
 
 #include <ui/FramebufferNativeWindow.h>
 #ifdef ADTF_ICS_AND_EARLIER
@@ -42,10 +45,47 @@
 #include <EGLUtils.h>
 #endif
 
+#include "../Histogram.h"
+
 #define RETURN_IF_FALSE(x,r) do {bool b = bool(x); if (!b) return r;} while(0)
 
 using namespace android;
 
+// Benchmark mode, off unless a frame count or duration is given. Warm-up
+// frames are rendered first and not measured.
+struct Benchmark {
+    long frames;        // Measured frames, 0 for no limit
+    long seconds;       // Measured time, 0 for no limit
+    long warmup;
+    const char *output; // JSON file, stdout if not set
+    FILE *stdoutJson;   // The original stdout, everything else goes to stderr
+
+    bool enabled() const
+    {
+        return frames > 0 || seconds > 0;
+    }
+};
+
+// Per frame times in us, named after what adtf's stat shows for a plugin
+// surface: render is the draw up to the swap (dr:), swap is eglSwapBuffers
+// (q:) and frame is both (u:). Frames the plugin asked to reinit in aren't
+// counted.
+struct BenchmarkResult {
+    Histogram render;
+    Histogram swap;
+    Histogram frame;
+    long reinits;
+    int64_t start;
+    int64_t end;
+};
+
+static int64_t nowUs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
 struct PluginFuncs {
     int (*create)(int, int, int, char**, void**);
     int (*chooseEGLConfig)(void*, EGLDisplay, EGLConfig*);
@@ -403,12 +443,121 @@ static bool destroyEglContextSurface(EGLDisplay dpy, EGLContext *context,
     return true;
 }
 
+static std::string jsonString(const char *s)
+{
+    std::string out = "\"";
+    for (; *s != '\0'; s++) {
+        if ((unsigned char)*s < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*s);
+            out += esc;
+            continue;
+        }
+        if (*s == '"' || *s == '\\')
+            out += '\\';
+        out += *s;
+    }
+    return out + "\"";
+}
+
+static bool writeBenchmark(const Benchmark& bench, const BenchmarkResult& result,
+        int argc, char **argv, EGLint w, EGLint h)
+{
+    FILE *f = bench.output != NULL ? fopen(bench.output, "w") : bench.stdoutJson;
+    if (f == NULL) {
+        printf("Can't open %s for writing\n", bench.output);
+        return false;
+    }
+
+    int64_t duration = result.end - result.start;
+    double fps = duration > 0 ? result.frame.count() * 1000000.0 / duration : 0;
+
+    fprintf(f, "{\n  \"plugin\": %s,\n  \"args\": [", jsonString(argv[0]).c_str());
+    for (int i = 1; i < argc; i++)
+        fprintf(f, "%s%s", i > 1 ? ", " : "", jsonString(argv[i]).c_str());
+    fprintf(f, "],\n");
+    fprintf(f, "  \"width\": %d,\n  \"height\": %d,\n", w, h);
+    fprintf(f, "  \"warmup\": %ld,\n  \"frames\": %llu,\n  \"reinits\": %ld,\n",
+            bench.warmup, (unsigned long long)result.frame.count(), result.reinits);
+    fprintf(f, "  \"duration_us\": %lld,\n  \"fps\": %.2f,\n", (long long)duration, fps);
+    fprintf(f, "  \"render_us\": %s,\n", result.render.toJson().c_str());
+    fprintf(f, "  \"swap_us\": %s,\n", result.swap.toJson().c_str());
+    fprintf(f, "  \"frame_us\": %s\n}\n", result.frame.toJson().c_str());
+
+    if (bench.output != NULL) {
+        fclose(f);
+        printf("Benchmark written to %s\n", bench.output);
+    } else {
+        fflush(f);
+    }
+    return true;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] libplugin.so <plugin args>\n", name);
+    printf("  -f <frames>   benchmark, measure this many frames\n");
+    printf("  -d <seconds>  benchmark, measure for this long\n");
+    printf("  -w <frames>   benchmark warm-up frames, not measured (default 60)\n");
+    printf("  -o <file>     benchmark JSON output (default stdout, with all other\n");
+    printf("                output going to stderr)\n");
+}
+
 int main(int argc, char** argv) {
 
-    if (argc < 2) {
-        printf("Usage: %s libplugin.so <plugin args>\n", argv[0]);
+    Benchmark bench;
+    bench.frames = 0;
+    bench.seconds = 0;
+    bench.warmup = 60;
+    bench.output = NULL;
+    bench.stdoutJson = NULL;
+
+    // Options end at the plugin, everything after it is the plugin's
+    int opt;
+    while ((opt = getopt(argc, argv, "+f:d:w:o:")) != -1) {
+        switch (opt) {
+            case 'f':
+                bench.frames = atol(optarg);
+                break;
+            case 'd':
+                bench.seconds = atol(optarg);
+                break;
+            case 'w':
+                bench.warmup = atol(optarg);
+                break;
+            case 'o':
+                bench.output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+
+    if (argc - optind < 1) {
+        usage(argv[0]);
         return 0;
     }
+    if (bench.frames < 0 || bench.seconds < 0 || bench.warmup < 0) {
+        printf("Benchmark frames, seconds and warm-up can't be negative\n");
+        usage(argv[0]);
+        return -1;
+    }
+
+    // Keep stdout for the JSON alone. What the harness and the plugin print
+    // goes to stderr instead, so that the output parses as it is.
+    if (bench.enabled() && bench.output == NULL) {
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        bench.stdoutJson = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (bench.stdoutJson == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "Can't move output off stdout\n");
+            return -1;
+        }
+    }
+
+    argc -= optind - 1;
+    argv += optind - 1;
 
     void *instance = NULL;
     PluginFuncs funcs;
@@ -477,9 +626,29 @@ int main(int argc, char** argv) {
 
     printf("Starting render loop\n");
 
+    BenchmarkResult result;
+    result.reinits = 0;
+    result.start = result.end = 0;
+    long frame = 0;
+
     for (;;) {
+        bool measured = bench.enabled() && frame >= bench.warmup;
+        if (measured) {
+            if (frame == bench.warmup) {
+                printf("Warm-up done, measuring\n");
+                result.start = nowUs();
+            }
+            if ((bench.frames > 0 && frame - bench.warmup >= bench.frames) ||
+                    (bench.seconds > 0 && nowUs() - result.start >= bench.seconds * 1000000))
+                break;
+        }
+        frame++;
+
+        bool reinit = false;
+        int64_t renderStart = nowUs();
         swap = true;
         status = funcs.render(instance);
+        int64_t renderEnd = nowUs();
 
         if (status < 0) {
             printf("Plugin render error %d\n", status);
@@ -495,6 +664,7 @@ int main(int argc, char** argv) {
                 RETURN_IF_FALSE(createEglSurface(dpy, window.get(), config, &surface, &w, &h), -1);
                 RETURN_IF_FALSE(createEglContext(dpy, &funcs, instance, config, surface, &context), -1);
                 swap = false;
+                reinit = true;
             } else if (status == 2) {
                 printf("plugin done\n");
                 break;
@@ -511,6 +681,27 @@ int main(int argc, char** argv) {
             eglSwapBuffers(dpy, surface);
             checkEglError("eglSwapBuffers");
         }
+
+        if (measured) {
+            int64_t swapEnd = nowUs();
+            if (reinit) {
+                result.reinits++;
+            } else {
+                result.render.add(renderEnd - renderStart);
+                if (swap)
+                    result.swap.add(swapEnd - renderEnd);
+                result.frame.add(swapEnd - renderStart);
+            }
+        }
+    }
+
+    if (bench.enabled()) {
+        result.end = nowUs();
+        if (result.start == 0) {
+            printf("Plugin stopped during warm-up, nothing measured\n");
+            result.start = result.end;
+        }
+        RETURN_IF_FALSE(writeBenchmark(bench, result, argc - 1, argv + 1, w, h), -1);
     }
 
     return 0;